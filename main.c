@@ -1,12 +1,338 @@
+// for thread affinity, MAP_HUGETLB and inotify
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #include <raylib.h>
 #include <raymath.h>
+#include <rlgl.h>
 
-// returns the distance a ray needs to travel to hit a wall on a 2D grid
-// if it doesn't hit a wall, returns the maximum distance the ray is allowed to travel
-float castRayDDA
+// every heap allocation goes through heapAlloc and friends so they can be counted, e.g. to
+// check that a frame doesn't allocate at all, the counters are atomic since worker threads
+// allocate too
+typedef struct HeapStats {
+    atomic_llong alloc_count;
+    atomic_llong free_count;
+} HeapStats;
+
+HeapStats heap_stats;
+
+void* heapAlloc(size_t size) {
+    atomic_fetch_add_explicit(&heap_stats.alloc_count, 1, memory_order_relaxed);
+    return malloc(size);
+}
+
+void* heapCalloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&heap_stats.alloc_count, 1, memory_order_relaxed);
+    return calloc(count, size);
+}
+
+// counts as an allocation, even if the block could be grown in place
+void* heapRealloc(void* ptr, size_t size) {
+    atomic_fetch_add_explicit(&heap_stats.alloc_count, 1, memory_order_relaxed);
+    return realloc(ptr, size);
+}
+
+void heapFree(void* ptr) {
+    if (ptr == NULL) return;
+    atomic_fetch_add_explicit(&heap_stats.free_count, 1, memory_order_relaxed);
+    free(ptr);
+}
+
+// returns the number of heap allocations made so far
+long long getHeapAllocCount(void) {
+    return atomic_load_explicit(&heap_stats.alloc_count, memory_order_relaxed);
+}
+
+// NOTE: malloc returns 16 byte aligned blocks on 64 bit platforms, so the arena memory
+//       and the overflow blocks are aligned to this too
+#define ARENA_ALIGNMENT 16
+
+// a bump allocator for data that only lives for one frame, allocating is a pointer bump
+// and resetArena frees everything at once
+// NOTE: when a frame needs more than the capacity, the rest is taken from the heap and
+//       the arena grows to fit on the next reset, so the steady state never allocates
+typedef struct Arena {
+    uint8_t* bytes;
+    size_t capacity;
+    size_t used;
+    // bytes asked for since the last reset, including those that didn't fit
+    size_t requested;
+    // the most bytes ever asked for between two resets
+    size_t peak;
+    // heap blocks for what didn't fit, freed by the next reset
+    void** overflow;
+    int overflow_count;
+    int overflow_capacity;
+} Arena;
+
+Arena createArena(size_t capacity) {
+    return (Arena){
+        .bytes = heapAlloc(capacity),
+        .capacity = capacity,
+    };
+}
+
+void destroyArena(Arena* arena) {
+    for (int i = 0; i < arena->overflow_count; i++) heapFree(arena->overflow[i]);
+    heapFree(arena->overflow);
+    heapFree(arena->bytes);
+    *arena = (Arena){ 0 };
+}
+
+// returns the number of bytes the arena holds on to between frames
+size_t getArenaBytes(const Arena* arena) {
+    return arena->capacity;
+}
+
+// returns size bytes aligned to ARENA_ALIGNMENT, valid until the next resetArena
+void* allocArena(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    arena->requested += size;
+    if (arena->requested > arena->peak) arena->peak = arena->requested;
+
+    if (size <= arena->capacity - arena->used) {
+        void* ptr = &arena->bytes[arena->used];
+        arena->used += size;
+        return ptr;
+    }
+
+    if (arena->overflow_count == arena->overflow_capacity) {
+        arena->overflow_capacity = (arena->overflow_capacity > 0) ? arena->overflow_capacity * 2 : 8;
+        arena->overflow = heapRealloc(arena->overflow, sizeof (void*) * arena->overflow_capacity);
+    }
+    void* ptr = heapAlloc(size);
+    arena->overflow[arena->overflow_count++] = ptr;
+    return ptr;
+}
+
+// frees everything allocated from the arena since the last reset
+void resetArena(Arena* arena) {
+    for (int i = 0; i < arena->overflow_count; i++) heapFree(arena->overflow[i]);
+    arena->overflow_count = 0;
+
+    if (arena->requested > arena->capacity) {
+        heapFree(arena->bytes);
+        arena->capacity = arena->requested + arena->requested / 2;
+        arena->bytes = heapAlloc(arena->capacity);
+    }
+    arena->used = 0;
+    arena->requested = 0;
+}
+
+#define HUGE_PAGE_BYTES ((size_t)2 << 20)
+
+// what backs a LargeBlock, huge pages cover 512 times as much memory per TLB entry as
+// normal 4 KB pages, which is what random rays over big grids spend most of their time on
+enum {
+    PAGES_NORMAL,
+    // transparent huge pages asked for with madvise, the kernel may still fall back
+    PAGES_TRANSPARENT_HUGE,
+    // reserved huge pages from MAP_HUGETLB, only if the system has some set aside
+    PAGES_HUGETLB,
+};
+
+// one big block straight from mmap instead of the heap
+typedef struct LargeBlock {
+    void* bytes;
+    size_t size;
+    int pages;
+} LargeBlock;
+
+// returns a zeroed block of at least size bytes, with use_huge_pages it is backed by
+// MAP_HUGETLB pages if there are any and by transparent huge pages otherwise
+// bytes is NULL if the memory can't be mapped at all
+LargeBlock allocLargeBlock(size_t size, bool use_huge_pages) {
+    LargeBlock block = { .size = size, .pages = PAGES_NORMAL };
+    if (use_huge_pages) block.size = (size + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+
+#ifdef MAP_HUGETLB
+    if (use_huge_pages) {
+        block.bytes = mmap(NULL, block.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (block.bytes != MAP_FAILED) {
+            block.pages = PAGES_HUGETLB;
+            atomic_fetch_add_explicit(&heap_stats.alloc_count, 1, memory_order_relaxed);
+            return block;
+        }
+    }
+#endif
+
+    // transparent huge pages are only used for 2 MB aligned ranges, so one huge page more
+    // is mapped and the unaligned ends are cut off again
+    const size_t padding = use_huge_pages ? HUGE_PAGE_BYTES : 0;
+    uint8_t* mapped = mmap(NULL, block.size + padding, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) return (LargeBlock){ 0 };
+    atomic_fetch_add_explicit(&heap_stats.alloc_count, 1, memory_order_relaxed);
+
+    if (!use_huge_pages) {
+        block.bytes = mapped;
+        return block;
+    }
+
+    const uintptr_t aligned = ((uintptr_t)mapped + HUGE_PAGE_BYTES - 1) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1);
+    const size_t head = aligned - (uintptr_t)mapped;
+    if (head > 0) munmap(mapped, head);
+    if (padding - head > 0) munmap((uint8_t*)aligned + block.size, padding - head);
+    block.bytes = (void*)aligned;
+    // NOTE: without MADV_HUGEPAGE (macOS) the block is only aligned and stays on normal pages
+#ifdef MADV_HUGEPAGE
+    if (madvise(block.bytes, block.size, MADV_HUGEPAGE) == 0) block.pages = PAGES_TRANSPARENT_HUGE;
+#endif
+    return block;
+}
+
+void freeLargeBlock(LargeBlock* block) {
+    if (block->bytes == NULL) return;
+    atomic_fetch_add_explicit(&heap_stats.free_count, 1, memory_order_relaxed);
+    munmap(block->bytes, block->size);
+    *block = (LargeBlock){ 0 };
+}
+
+// the layers a cell can block, a ray query passes the layers it cares about and stops at
+// the first cell with (cell & layer_mask) != 0, so one map serves every kind of query
+enum {
+    LAYER_VISION = 1 << 0,
+    LAYER_BULLETS = 1 << 1,
+    LAYER_WALKERS = 1 << 2,
+    LAYER_SOUND = 1 << 3,
+    LAYER_ALL = 0xff,
+};
+
+// the shape of the blocking part of a cell, stored above the layer byte
+// slopes are half solid cells that are split along a diagonal, the name tells which
+// corner of the cell the solid half covers (north is up on screen)
+#define CELL_SHAPE_SHIFT 8
+
+enum {
+    SHAPE_FULL,
+    SHAPE_SLOPE_NW,
+    SHAPE_SLOPE_NE,
+    SHAPE_SLOPE_SW,
+    SHAPE_SLOPE_SE,
+};
+
+// the values a cell of the map commonly holds
+// NOTE: any other non zero value is a full cell that blocks only vision, which is what
+//       maps that mark walls with 1 get
+enum {
+    CELL_OPEN = 0,
+    CELL_SOLID = LAYER_ALL,
+    // stops bullets and walkers, but can be seen and heard through
+    CELL_WINDOW = LAYER_BULLETS | LAYER_WALKERS,
+    CELL_SLOPE_NW = (SHAPE_SLOPE_NW << CELL_SHAPE_SHIFT) | LAYER_ALL,
+    CELL_SLOPE_NE = (SHAPE_SLOPE_NE << CELL_SHAPE_SHIFT) | LAYER_ALL,
+    CELL_SLOPE_SW = (SHAPE_SLOPE_SW << CELL_SHAPE_SHIFT) | LAYER_ALL,
+    CELL_SLOPE_SE = (SHAPE_SLOPE_SE << CELL_SHAPE_SHIFT) | LAYER_ALL,
+};
+
+// the solid half of each slope shape, as the half plane a * u + b * v + c > 0, where u/v
+// are the coordinates inside the cell from 0 to 1, in the order of the SHAPE_SLOPE values
+const float slope_planes[4][3] = {
+    { -1.0f, -1.0f, 1.0f },
+    { 1.0f, -1.0f, 0.0f },
+    { -1.0f, 1.0f, 0.0f },
+    { 1.0f, 1.0f, -1.0f },
+};
+
+// the corners of the solid half of each slope shape as u/v inside the cell, in the same
+// order as slope_planes
+const float slope_corners[4][3][2] = {
+    { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.0f, 1.0f } },
+    { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f } },
+    { { 0.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f } },
+    { { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f } },
+};
+
+// checks where a ray that is inside the slope cell at cell_x/cell_y from entry to exit
+// distance first touches the solid half
+// a ray that enters through one of the solid sides stops right at entry, otherwise it
+// stops where it meets the diagonal, if it does so before exit
+// returns false if the ray passes through the open half only
+bool intersectSlopeCell
+(
+    int cell,
+    Vector2 start_pos,
+    Vector2 direction,
+    int cell_x,
+    int cell_y,
+    float tile_size,
+    float entry,
+    float exit,
+    float* hit_distance
+) {
+    const float* plane = slope_planes[(cell >> CELL_SHAPE_SHIFT) - SHAPE_SLOPE_NW];
+
+    const float u = (start_pos.x + direction.x * entry) / tile_size - (float)cell_x;
+    const float v = (start_pos.y + direction.y * entry) / tile_size - (float)cell_y;
+    const float f = plane[0] * u + plane[1] * v + plane[2];
+    if (f >= 0.0f) {
+        *hit_distance = entry;
+        return true;
+    }
+
+    // how fast the ray approaches the diagonal per unit of distance
+    const float g = (plane[0] * direction.x + plane[1] * direction.y) / tile_size;
+    if (g <= 0.0f) return false;
+
+    const float t = entry - f / g;
+    if (t > exit) return false;
+    *hit_distance = t;
+    return true;
+}
+
+// checks if a ray that is inside a cell from entry to exit distance is stopped by it,
+// with the layers of layer_mask, hit_distance receives where
+bool isCellHit
+(
+    int cell,
+    int layer_mask,
+    Vector2 start_pos,
+    Vector2 direction,
+    int cell_x,
+    int cell_y,
+    float tile_size,
+    float entry,
+    float exit,
+    float* hit_distance
+) {
+    if ((cell & layer_mask) == 0) return false;
+
+    *hit_distance = entry;
+    if ((cell >> CELL_SHAPE_SHIFT) == SHAPE_FULL) return true;
+    return intersectSlopeCell(cell, start_pos, direction, cell_x, cell_y, tile_size, entry, exit, hit_distance);
+}
+
+// describes where a ray cast by castRayDDAHit has stopped
+typedef struct RayHit {
+    // the distance the ray has traveled, or the maximum distance if it hasn't hit a wall
+    float distance;
+    // the grid space coordinates of the cell the ray has stopped in
+    int cell_x;
+    int cell_y;
+    // the kind of grid line the ray has crossed last
+    // 0 if it was a vertical grid line (x step), 1 if it was a horizontal one (y step),
+    // SIDE_SLOPE if the ray has stopped on the diagonal of a slope cell
+    int side;
+    // denotes if the ray has hit a wall before reaching its maximum distance
+    bool has_hit_wall;
+} RayHit;
+
+#define SIDE_SLOPE 3
+
+// same as castRayDDA, but returns a full hit record instead of only the distance
+// the cell and side are what callers need to tell whether two rays hit the same wall
+RayHit castRayDDAHit
 (
     // the starting position of the ray (x/y coordinates)
     Vector2 start_pos,
@@ -22,7 +348,9 @@ float castRayDDA
     // the side length of one grid cell
     float tile_size,
     // the maximum distance the ray is allowed to travel
-    float max_distance
+    float max_distance,
+    // the layers that stop the ray, see LAYER_VISION
+    int layer_mask
 ) {
     // calculate the direction to step in pixel space each iteration relative to one
     // grid cell
@@ -75,6 +403,9 @@ float castRayDDA
     // used to break out of the loop that calculates the total distance traveled
     bool has_hit_wall = false;
 
+    // the kind of grid line that was crossed last, see RayHit
+    int side = 0;
+
     // is set to the larger value of ray_len.x or ray_len.y each iteration to simplify
     // checks and calculating the end_pos as well as to not overstep if the ray hits a
     // wall
@@ -85,6 +416,7 @@ float castRayDDA
         if (ray_len.x < ray_len.y) {
             // step in the horizontal direction in grid space
             cur_map_x += step_x;
+            side = 0;
 
             // cache the distance to not overstep if the ray hits a wall
             distance = ray_len.x;
@@ -96,6 +428,7 @@ float castRayDDA
         } else {
             // step in the vertical direction in grid space
             cur_map_y += step_y;
+            side = 1;
 
             // cache the distance to not overstep if the ray hits a wall
             distance = ray_len.y;
@@ -117,229 +450,7292 @@ float castRayDDA
             // NOTE: depending on the type of the values stored in the array,
             //       this check may access fields or use different logic to
             //       determine if a grid cell is marked as a wall
-            if (map[cur_map_y][cur_map_x] == 1) {
-                // set has_hit_wall to true to break out of the loop on the next
-                // iteration and retain the correct value for distance
-                has_hit_wall = true;
+            // NOTE: open cells and cells that only block other layers cost the one
+            //       test, slope cells are rare and checked behind the full shape test
+            const int cell = map[cur_map_y][cur_map_x];
+            if ((cell & layer_mask) != 0) {
+                if ((cell >> CELL_SHAPE_SHIFT) == SHAPE_FULL) {
+                    // set has_hit_wall to true to break out of the loop on the next
+                    // iteration and retain the correct value for distance
+                    has_hit_wall = true;
+                } else {
+                    // the ray is inside the cell until it reaches the next grid line
+                    float slope_distance;
+                    has_hit_wall = intersectSlopeCell(
+                        cell,
+                        start_pos,
+                        direction,
+                        cur_map_x,
+                        cur_map_y,
+                        tile_size,
+                        distance,
+                        fminf(ray_len.x, ray_len.y),
+                        &slope_distance
+                    );
+                    if (has_hit_wall && slope_distance > distance) {
+                        distance = slope_distance;
+                        side = SIDE_SLOPE;
+                    }
+                }
             }
         }
     }
 
-    // return the distance the ray has traveled if it has hit a wall,
-    // otherwise return the maximum distance the ray is allowed to travel
-    return (has_hit_wall) ? distance : max_distance;
+    // report the distance the ray has traveled if it has hit a wall,
+    // otherwise report the maximum distance the ray is allowed to travel
+    return (RayHit){
+        .distance = (has_hit_wall) ? distance : max_distance,
+        .cell_x = cur_map_x,
+        .cell_y = cur_map_y,
+        .side = side,
+        .has_hit_wall = has_hit_wall,
+    };
 }
 
-void drawDottedLine(Vector2 start_pos, Vector2 end_pos, Color color);
-
-int main(void) {
-    const int screen_width = 800;
-    const int screen_height = 800;
-
-    InitWindow(screen_width, screen_height, "raycasting");
-
-    const int map_rows = 80;
-    const int map_cols = 80;
+// returns the distance a ray needs to travel to hit a wall on a 2D grid
+// if it doesn't hit a wall, returns the maximum distance the ray is allowed to travel
+float castRayDDA
+(
+    // the starting position of the ray (x/y coordinates)
+    Vector2 start_pos,
+    // the direction the ray is cast in (normalized unit vector)
+    Vector2 direction,
+    // a 2D grid of cells that can be marked as wall
+    // NOTE: the pointer type may differ depending on how the map is structured
+    int** map,
+    // the number of rows in the grid
+    int map_rows,
+    // the number of columns in the grid
+    int map_cols,
+    // the side length of one grid cell
+    float tile_size,
+    // the maximum distance the ray is allowed to travel
+    float max_distance
+) {
+    return castRayDDAHit(
+        start_pos,
+        direction,
+        map,
+        map_rows,
+        map_cols,
+        tile_size,
+        max_distance,
+        LAYER_ALL
+    ).distance;
+}
 
-    int** map = malloc(sizeof (int*) * map_rows);
-    for (int i = 0; i < map_rows; i++) {
-        map[i] = calloc(map_cols, sizeof (int));
-    }
+// walks every cell a ray touches (a supercover), for code that needs all of them and
+// not only the first wall, like occupancy updates, damage along a line or sound
+// occlusion
+// usage:
+//     RayCellIter it = beginRayCells(start_pos, direction, tile_size, max_distance);
+//     while (nextRayCell(&it)) {
+//         // it.cell_x/it.cell_y is touched between it.entry and it.exit
+//     }
+// if the ray runs exactly through a grid corner, where castRayDDAHit just picks the
+// vertical grid line, both cells beside the corner are visited with entry == exit
+// before the diagonal cell, so nothing can slip through between two walls that only
+// share a corner
+// NOTE: the functions are static inline so every loop gets its own copy of the step
+//       code instead of going through a callback for each cell
+// NOTE: unlike castRayDDAHit, the start cell is found with floorf, which puts negative
+//       coordinates into the right cell, and the start cell is visited as well
+typedef struct RayCellIter {
+    // the cell that was visited last and where the ray is inside it
+    int cell_x;
+    int cell_y;
+    float entry;
+    float exit;
+    // the cell the ray is in, which only differs from cell_x/cell_y while the two cells
+    // beside a corner are visited
+    int x;
+    int y;
+    int step_x;
+    int step_y;
+    // the distance the ray travels to cross one cell in each direction
+    float delta_x;
+    float delta_y;
+    // the distance at which the ray crosses the next vertical/horizontal grid line
+    float next_x;
+    float next_y;
+    float max_distance;
+    // how the ray has entered the visited cell, 0 through a vertical grid line (x step),
+    // 1 through a horizontal one (y step), 2 through a corner and -1 for the start cell
+    int side;
+    // 0 before the first cell, 1 while walking, 2 and 3 while visiting the two cells
+    // beside a corner
+    int phase;
+} RayCellIter;
 
-    const float tile_size = 20.0f;
+static inline RayCellIter beginRayCells(Vector2 start_pos, Vector2 direction, float tile_size, float max_distance) {
+    RayCellIter it = {
+        .x = (int)floorf(start_pos.x / tile_size),
+        .y = (int)floorf(start_pos.y / tile_size),
+        .step_x = (direction.x < 0.0f) ? -1 : 1,
+        .step_y = (direction.y < 0.0f) ? -1 : 1,
+        .delta_x = (direction.x != 0.0f) ? tile_size / fabsf(direction.x) : INFINITY,
+        .delta_y = (direction.y != 0.0f) ? tile_size / fabsf(direction.y) : INFINITY,
+        .max_distance = max_distance,
+    };
 
-    Vector2 origin_pos = { (float)screen_width / 2.0f, (float)screen_height / 2.0f };
-    Vector2 target_pos = GetMousePosition();
+    const float line_x = (float)(it.x + (it.step_x > 0)) * tile_size;
+    const float line_y = (float)(it.y + (it.step_y > 0)) * tile_size;
+    it.next_x = (direction.x != 0.0f) ? (line_x - start_pos.x) / direction.x : INFINITY;
+    it.next_y = (direction.y != 0.0f) ? (line_y - start_pos.y) / direction.y : INFINITY;
+    return it;
+}
 
-    const float origin_spd = 8.0f;
+// moves to the next cell, returns false once the ray has traveled max_distance
+static inline bool nextRayCell(RayCellIter* it) {
+    if (it->phase == 1) {
+        if (it->exit >= it->max_distance) return false;
 
-    Vector2 ray_pos = { -100.0f, -100.0f };
-    const float max_ray_len = 1000.0f;
+        if (it->next_x < it->next_y) {
+            it->x += it->step_x;
+            it->next_x += it->delta_x;
+            it->side = 0;
+        } else if (it->next_y < it->next_x) {
+            it->y += it->step_y;
+            it->next_y += it->delta_y;
+            it->side = 1;
+        } else {
+            // first cell beside the corner, which is only touched in one point
+            it->cell_x = it->x + it->step_x;
+            it->entry = it->exit;
+            it->side = 2;
+            it->phase = 2;
+            return true;
+        }
+    } else if (it->phase == 2) {
+        // second cell beside the corner
+        it->cell_x = it->x;
+        it->cell_y = it->y + it->step_y;
+        it->phase = 3;
+        return true;
+    } else if (it->phase == 3) {
+        // the diagonal cell behind the corner
+        it->x += it->step_x;
+        it->y += it->step_y;
+        it->next_x += it->delta_x;
+        it->next_y += it->delta_y;
+        it->phase = 1;
+    } else {
+        it->side = -1;
+        it->phase = 1;
+    }
 
-    SetTargetFPS(60);
-    while (!WindowShouldClose()) {
-        if (IsKeyDown(KEY_W)) origin_pos.y -= origin_spd;
-        if (IsKeyDown(KEY_A)) origin_pos.x -= origin_spd;
-        if (IsKeyDown(KEY_S)) origin_pos.y += origin_spd;
-        if (IsKeyDown(KEY_D)) origin_pos.x += origin_spd;
-        
-        target_pos = GetMousePosition();
+    it->cell_x = it->x;
+    it->cell_y = it->y;
+    it->entry = it->exit;
+    it->exit = (it->next_x < it->next_y) ? it->next_x : it->next_y;
+    if (it->exit > it->max_distance) it->exit = it->max_distance;
+    return true;
+}
 
-        const int tile_x = (int)(target_pos.x / tile_size);
-        const int tile_y = (int)(target_pos.y / tile_size);
+// same as castRayDDAHit, but built on the supercover walk, so a ray that runs exactly
+// through the corner between two diagonal walls stops there instead of slipping through
+// NOTE: a wall that is only touched in a corner is reported as hit at that corner, with
+//       side set to 2
+RayHit castRaySupercover
+(
+    Vector2 start_pos,
+    Vector2 direction,
+    int** map,
+    int map_rows,
+    int map_cols,
+    float tile_size,
+    float max_distance,
+    int layer_mask
+) {
+    RayCellIter it = beginRayCells(start_pos, direction, tile_size, max_distance);
+    while (nextRayCell(&it)) {
+        // like castRayDDAHit, the cell the ray starts in is never a hit
+        if (it.side < 0) continue;
+        if (it.cell_x < 0 || it.cell_x >= map_cols || it.cell_y < 0 || it.cell_y >= map_rows) continue;
 
+        float distance;
         if
         (
-            tile_x >= 0 && tile_x < map_cols &&
-            tile_y >= 0 && tile_y < map_rows
+            isCellHit(
+                map[it.cell_y][it.cell_x],
+                layer_mask,
+                start_pos,
+                direction,
+                it.cell_x,
+                it.cell_y,
+                tile_size,
+                it.entry,
+                it.exit,
+                &distance
+            )
         ) {
-            if (IsMouseButtonDown(MOUSE_LEFT_BUTTON)) map[tile_y][tile_x] = 1;
-            else if (IsMouseButtonDown(MOUSE_RIGHT_BUTTON)) map[tile_y][tile_x] = 0;
+            return (RayHit){
+                .distance = distance,
+                .cell_x = it.cell_x,
+                .cell_y = it.cell_y,
+                .side = (distance > it.entry) ? SIDE_SLOPE : it.side,
+                .has_hit_wall = true,
+            };
         }
+    }
 
-        if (IsKeyPressed(KEY_C)) {
-            for (int i = 0; i < map_rows; i++) {
-                for (int j = 0; j < map_cols; j++) {
-                    map[i][j] = 0;
-                }
-            }
-        }
+    return (RayHit){
+        .distance = max_distance,
+        .cell_x = it.cell_x,
+        .cell_y = it.cell_y,
+        .side = it.side,
+        .has_hit_wall = false,
+    };
+}
 
-        const Vector2 ray_dir = Vector2Normalize(Vector2Subtract(target_pos, origin_pos));
+// one ray of a fan cast around an origin point
+typedef struct FanRay {
+    // the angle of the ray in radians, measured from the positive x-axis
+    float angle;
+    // the point where the ray has stopped
+    Vector2 end_pos;
+    // the hit record returned by castRayDDAHit
+    RayHit hit;
+} FanRay;
 
-        const float intersection_distance = castRayDDA(
-            origin_pos,
-            ray_dir,
-            map,
-            map_rows,
-            map_cols,
-            tile_size,
-            max_ray_len
-        );
+// everything an adaptive fan needs to know besides the two rays it is refining
+// bundled up so the recursion doesn't have to pass a dozen parameters around
+typedef struct FanContext {
+    Vector2 origin;
+    int** map;
+    int map_rows;
+    int map_cols;
+    float tile_size;
+    float max_distance;
+    // rays closer together than this (in radians) are never subdivided further
+    float angle_tolerance;
+    // the difference in distance at which two neighbouring rays count as disagreeing
+    float distance_jump;
+    // the output buffer and how much of it is used
+    FanRay* rays;
+    int ray_count;
+    int max_rays;
+    // the number of castRayDDAHit calls made so far
+    int rays_cast;
+} FanContext;
 
-        ray_pos = Vector2Add(origin_pos, Vector2Scale(ray_dir, intersection_distance));
+FanRay castFanRay(FanContext* ctx, float angle) {
+    const Vector2 direction = { cosf(angle), sinf(angle) };
+    const RayHit hit = castRayDDAHit(
+        ctx->origin,
+        direction,
+        ctx->map,
+        ctx->map_rows,
+        ctx->map_cols,
+        ctx->tile_size,
+        ctx->max_distance,
+        LAYER_ALL
+    );
+    ctx->rays_cast++;
 
-        BeginDrawing();
+    return (FanRay){
+        .angle = angle,
+        .end_pos = Vector2Add(ctx->origin, Vector2Scale(direction, hit.distance)),
+        .hit = hit,
+    };
+}
 
-        ClearBackground(BLACK);
+// checks if the cell at the given grid coordinates is a full wall on any layer
+// cells outside of the grid are never walls, just like in castRayDDAHit
+bool isWallCell(int** map, int map_rows, int map_cols, int x, int y) {
+    if (x < 0 || x >= map_cols || y < 0 || y >= map_rows) return false;
+    return map[y][x] != CELL_OPEN && (map[y][x] >> CELL_SHAPE_SHIFT) == SHAPE_FULL;
+}
 
-        // draw horizontal grid lines
-        for (int i = 0; i < map_rows; i++) {
-            DrawLine(0, i * (int)tile_size, screen_width, i * (int)tile_size, GRAY);
+// returns true if two neighbouring rays of a fan see the same wall face, which means
+// that nothing can be gained by casting more rays between them
+bool fanRaysAgree(const FanContext* ctx, const FanRay* a, const FanRay* b) {
+    if (a->hit.has_hit_wall != b->hit.has_hit_wall) return false;
+    if (!a->hit.has_hit_wall) return true;
+    if (fabsf(a->hit.distance - b->hit.distance) > ctx->distance_jump) return false;
+    if (a->hit.side != b->hit.side) return false;
+    if (a->hit.cell_x == b->hit.cell_x && a->hit.cell_y == b->hit.cell_y) return true;
+
+    // different cells can still belong to one flat wall, which is the common case
+    // the face is only continuous if every cell between the two hits is a wall and
+    // every cell in front of them (on the side the rays come from) is open
+    // NOTE: this only reads the grid, which is a lot cheaper than casting rays
+    if (a->hit.side == 0) {
+        if (a->hit.cell_x != b->hit.cell_x) return false;
+        const int front_x = a->hit.cell_x + ((ctx->origin.x < a->end_pos.x) ? -1 : 1);
+        const int y0 = (a->hit.cell_y < b->hit.cell_y) ? a->hit.cell_y : b->hit.cell_y;
+        const int y1 = (a->hit.cell_y < b->hit.cell_y) ? b->hit.cell_y : a->hit.cell_y;
+        for (int y = y0; y <= y1; y++) {
+            if (!isWallCell(ctx->map, ctx->map_rows, ctx->map_cols, a->hit.cell_x, y)) return false;
+            if (isWallCell(ctx->map, ctx->map_rows, ctx->map_cols, front_x, y)) return false;
         }
-        // draw vertical grid lines
-        for (int i = 0; i < map_cols; i++) {
-            DrawLine(i* (int)tile_size, 0, i * (int)tile_size, screen_height, GRAY);
+    } else {
+        if (a->hit.cell_y != b->hit.cell_y) return false;
+        const int front_y = a->hit.cell_y + ((ctx->origin.y < a->end_pos.y) ? -1 : 1);
+        const int x0 = (a->hit.cell_x < b->hit.cell_x) ? a->hit.cell_x : b->hit.cell_x;
+        const int x1 = (a->hit.cell_x < b->hit.cell_x) ? b->hit.cell_x : a->hit.cell_x;
+        for (int x = x0; x <= x1; x++) {
+            if (!isWallCell(ctx->map, ctx->map_rows, ctx->map_cols, x, a->hit.cell_y)) return false;
+            if (isWallCell(ctx->map, ctx->map_rows, ctx->map_cols, x, front_y)) return false;
         }
-        // draw tiles
-        for (int i = 0; i < map_rows; i++) {
-            for (int j = 0; j < map_cols; j++) {
-                if (map[i][j] == 1) {
-                    DrawRectangle(
-                        (int)((float)j * tile_size),
-                        (int)((float)i * tile_size),
-                        (int)tile_size,
-                        (int)tile_size,
-                        WHITE
-                    );
-                }
-            }
+    }
+
+    return true;
+}
+
+// appends the rays strictly between a and b to the output, in order of their angle
+void subdivideFan(FanContext* ctx, const FanRay* a, const FanRay* b) {
+    if (b->angle - a->angle <= ctx->angle_tolerance) return;
+    if (fanRaysAgree(ctx, a, b)) return;
+    if (ctx->ray_count >= ctx->max_rays) return;
+
+    const FanRay mid = castFanRay(ctx, 0.5f * (a->angle + b->angle));
+
+    subdivideFan(ctx, a, &mid);
+    if (ctx->ray_count < ctx->max_rays) ctx->rays[ctx->ray_count++] = mid;
+    subdivideFan(ctx, &mid, b);
+}
+
+// casts a full 360 degree fan of rays around origin, starting with coarse_count evenly
+// spaced rays and only adding rays between neighbours that don't see the same wall face
+// the resulting outline is the same as a dense fan with one ray every angle_tolerance
+// radians, but flat walls and open space are covered by only a handful of rays
+// writes the rays sorted by angle to rays and returns how many were written
+// rays_cast receives the number of castRayDDAHit calls that were made
+// NOTE: features narrower than the coarse spacing can fall between two coarse rays that
+//       agree, so coarse_count should be chosen with the smallest feature in mind
+int castAdaptiveFan
+(
+    // the point all rays start from
+    Vector2 origin,
+    // the grid and its dimensions, see castRayDDA
+    int** map,
+    int map_rows,
+    int map_cols,
+    float tile_size,
+    // the maximum distance each ray is allowed to travel
+    float max_distance,
+    // the number of evenly spaced rays to start with
+    int coarse_count,
+    // the smallest angle (in radians) between two rays
+    float angle_tolerance,
+    // neighbouring rays whose distances differ by more than this are always refined
+    float distance_jump,
+    // the output buffer, which should hold at least 2 * PI / angle_tolerance rays
+    FanRay* rays,
+    int max_rays,
+    // receives the number of rays that were actually cast
+    int* rays_cast
+) {
+    FanContext ctx = {
+        .origin = origin,
+        .map = map,
+        .map_rows = map_rows,
+        .map_cols = map_cols,
+        .tile_size = tile_size,
+        .max_distance = max_distance,
+        .angle_tolerance = angle_tolerance,
+        .distance_jump = distance_jump,
+        .rays = rays,
+        .ray_count = 0,
+        .max_rays = max_rays,
+        .rays_cast = 0,
+    };
+
+    const float coarse_step = 2.0f * PI / (float)coarse_count;
+
+    const FanRay first = castFanRay(&ctx, 0.0f);
+    FanRay prev = first;
+    for (int i = 1; i <= coarse_count && ctx.ray_count < max_rays; i++) {
+        // the last interval closes the fan, so it ends at a copy of the first ray
+        FanRay next = first;
+        if (i < coarse_count) {
+            next = castFanRay(&ctx, (float)i * coarse_step);
+        } else {
+            next.angle = 2.0f * PI;
         }
-        // draw line from origin to target
-        DrawLineV(origin_pos, target_pos, YELLOW);      
-        // draw line that continues after target
-        drawDottedLine(
-            target_pos,
-            Vector2Add(target_pos, Vector2Scale(ray_dir, 100.0f * max_ray_len)),
-            YELLOW
-        );
-        // draw origin
-        DrawCircleV(origin_pos, 5.0f, RED);
-        // draw target
-        DrawCircleV(target_pos, 5.0f, GREEN);
-        // draw raycast intersection point
-        DrawCircleV(ray_pos, 2.0f, BLUE);
-        DrawCircleLinesV(ray_pos, 6.0f, BLUE);
 
-        // draw text
-        const int font_size = 20;
-        const int margin = 5;
+        rays[ctx.ray_count++] = prev;
+        subdivideFan(&ctx, &prev, &next);
+        prev = next;
+    }
 
-        const int buf_size = 50;
+    if (rays_cast != NULL) *rays_cast = ctx.rays_cast;
+    return ctx.ray_count;
+}
 
-        char ori_buf[buf_size];
-        snprintf(ori_buf, buf_size, "ORI: %.1f / %.1f", origin_pos.x, origin_pos.y);
+// a coarse grid that counts the walls inside square blocks of cells
+// lets segment queries step over whole blocks of open space at once
+typedef struct OccupancyBlocks {
+    // the side length of one block in cells
+    int block_size;
+    // the number of blocks in each direction
+    int rows;
+    int cols;
+    // the number of wall cells inside each block, stored row by row
+    int* counts;
+} OccupancyBlocks;
 
-        char tar_buf[buf_size];
-        snprintf(tar_buf, buf_size, "TAR: %.1f / %.1f", target_pos.x, target_pos.y);
+OccupancyBlocks createOccupancyBlocks(int** map, int map_rows, int map_cols, int block_size) {
+    OccupancyBlocks occ = {
+        .block_size = block_size,
+        .rows = (map_rows + block_size - 1) / block_size,
+        .cols = (map_cols + block_size - 1) / block_size,
+    };
+    occ.counts = heapCalloc((size_t)occ.rows * (size_t)occ.cols, sizeof (int));
 
-        char ray_buf[buf_size];
-        snprintf(ray_buf, buf_size, "RAY: %.1f / %.1f", ray_pos.x, ray_pos.y);
+    for (int i = 0; i < map_rows; i++) {
+        for (int j = 0; j < map_cols; j++) {
+            if (map[i][j] != 0) occ.counts[(i / block_size) * occ.cols + j / block_size]++;
+        }
+    }
 
-        char len_buf[buf_size];
-        snprintf(len_buf, buf_size, "LEN: %.4f", intersection_distance);
+    return occ;
+}
 
-        DrawRectangle(
-            0,
-            0,
-            220,
-            5 + 4 * font_size + 4 * margin,
-            BLACK
-        );
-        DrawText(ori_buf, 5, 5, font_size, RED);
-        DrawText(tar_buf, 5, 5 + font_size + margin, font_size, GREEN);
-        DrawText(ray_buf, 5, 5 + 2 * font_size + 2 * margin, font_size, BLUE);
-        DrawText(len_buf, 5, 5 + 3 * font_size + 3 * margin, font_size, YELLOW);
+void destroyOccupancyBlocks(OccupancyBlocks* occ) {
+    heapFree(occ->counts);
+    occ->counts = NULL;
+}
 
-        const int tooltip_x = screen_width - 280;
+size_t getOccupancyBlocksBytes(const OccupancyBlocks* occ) {
+    return sizeof (int) * (size_t)occ->rows * (size_t)occ->cols;
+}
 
-        DrawRectangle(
-            tooltip_x - 5,
-            0,
-            285,
-            5 + 5 * font_size + 5 * margin,
-            BLACK
-        );
-        DrawText(
-            "[wasd] to move origin",
-            tooltip_x,
+// returns true if the ray from start_pos travels length units without entering a wall
+// walks the occupancy blocks first and only looks at single cells inside blocks that
+// contain at least one wall, which makes the query cheap in open space
+// NOTE: like castRayDDAHit, the cell start_pos lies in is not checked
+bool isSegmentClear
+(
+    Vector2 start_pos,
+    // normalized direction of the segment
+    Vector2 direction,
+    // the length of the segment
+    float length,
+    int** map,
+    int map_rows,
+    int map_cols,
+    float tile_size,
+    const OccupancyBlocks* occ
+) {
+    // this is castRayDDAHit on the block grid, see there for the details
+    const float block_len = tile_size * (float)occ->block_size;
+    const Vector2 step_dir = {
+        .x = sqrtf(1.0f + (direction.y / direction.x) * (direction.y / direction.x)),
+        .y = sqrtf(1.0f + (direction.x / direction.y) * (direction.x / direction.y)),
+    };
+    const int step_x = (direction.x < 0.0f) ? -1 : 1;
+    const int step_y = (direction.y < 0.0f) ? -1 : 1;
+
+    int block_x = (int)floorf(start_pos.x / block_len);
+    int block_y = (int)floorf(start_pos.y / block_len);
+
+    Vector2 ray_len;
+    if (step_x == -1) {
+        ray_len.x = (start_pos.x - (float)block_x * block_len) * step_dir.x;
+    } else {
+        ray_len.x = ((float)(block_x + 1) * block_len - start_pos.x) * step_dir.x;
+    }
+    if (step_y == -1) {
+        ray_len.y = (start_pos.y - (float)block_y * block_len) * step_dir.y;
+    } else {
+        ray_len.y = ((float)(block_y + 1) * block_len - start_pos.y) * step_dir.y;
+    }
+
+    // the distance at which the ray has entered the current block
+    float block_enter = 0.0f;
+
+    while (block_enter < length) {
+        const float block_exit = fminf(fminf(ray_len.x, ray_len.y), length);
+
+        if
+        (
+            block_x >= 0 && block_x < occ->cols &&
+            block_y >= 0 && block_y < occ->rows &&
+            occ->counts[block_y * occ->cols + block_x] > 0
+        ) {
+            // walk the cells of this block that the segment crosses
+            // the first cell is only checked if the segment enters it from outside,
+            // the cell the segment starts in is skipped on purpose
+            const Vector2 enter_pos = Vector2Add(start_pos, Vector2Scale(direction, block_enter));
+            if (block_enter > 0.0f) {
+                // enter_pos lies on the edge of the block, which can round into the block
+                // the segment comes from, the entered cell is always inside this block
+                const int block_x0 = block_x * occ->block_size;
+                const int block_y0 = block_y * occ->block_size;
+                const int cell_x = (int)Clamp(floorf(enter_pos.x / tile_size), (float)block_x0, (float)(block_x0 + occ->block_size - 1));
+                const int cell_y = (int)Clamp(floorf(enter_pos.y / tile_size), (float)block_y0, (float)(block_y0 + occ->block_size - 1));
+
+                // the inner castRayDDAHit skips its first cell, so it's tested here with
+                // its shape, the segment is inside it until it crosses the next grid line
+                float cell_exit_x = INFINITY;
+                float cell_exit_y = INFINITY;
+                if (direction.x != 0.0f) {
+                    cell_exit_x = ((float)(cell_x + (step_x > 0)) * tile_size - start_pos.x) / direction.x;
+                }
+                if (direction.y != 0.0f) {
+                    cell_exit_y = ((float)(cell_y + (step_y > 0)) * tile_size - start_pos.y) / direction.y;
+                }
+                float hit_distance;
+                if
+                (
+                    cell_x < map_cols && cell_y < map_rows &&
+                    isCellHit(
+                        map[cell_y][cell_x],
+                        LAYER_ALL,
+                        start_pos,
+                        direction,
+                        cell_x,
+                        cell_y,
+                        tile_size,
+                        block_enter,
+                        fminf(fminf(cell_exit_x, cell_exit_y), block_exit),
+                        &hit_distance
+                    ) &&
+                    hit_distance < length
+                ) {
+                    return false;
+                }
+            }
+
+            const RayHit hit = castRayDDAHit(
+                enter_pos,
+                direction,
+                map,
+                map_rows,
+                map_cols,
+                tile_size,
+                block_exit - block_enter,
+                LAYER_ALL
+            );
+            if (hit.has_hit_wall && block_enter + hit.distance < length) return false;
+        }
+
+        if (ray_len.x < ray_len.y) {
+            block_x += step_x;
+            block_enter = ray_len.x;
+            ray_len.x += step_dir.x * block_len;
+        } else {
+            block_y += step_y;
+            block_enter = ray_len.y;
+            ray_len.y += step_dir.y * block_len;
+        }
+    }
+
+    return true;
+}
+
+// remembers where each ray of a fixed set of rays (e.g. a fan or the columns of a
+// first-person view) has hit a wall in the previous frame
+// as long as the origin only moves a little, most rays hit the same wall face again,
+// which can be verified a lot cheaper than traversing the grid from scratch
+typedef struct RayCache {
+    // the number of rays the cache has room for
+    int ray_count;
+    // the hit record of each ray from the previous frame
+    RayHit* hits;
+    // the number of rays that were answered from the cache since the last reset
+    int reused;
+    // the number of rays that needed a full traversal since the last reset
+    int traversed;
+} RayCache;
+
+RayCache createRayCache(int ray_count) {
+    return (RayCache){
+        .ray_count = ray_count,
+        // zero initialized hits have has_hit_wall set to false, so nothing is reused
+        .hits = heapCalloc(ray_count, sizeof (RayHit)),
+        .reused = 0,
+        .traversed = 0,
+    };
+}
+
+void destroyRayCache(RayCache* cache) {
+    heapFree(cache->hits);
+    cache->hits = NULL;
+    cache->ray_count = 0;
+}
+
+size_t getRayCacheBytes(const RayCache* cache) {
+    return sizeof (RayHit) * (size_t)cache->ray_count;
+}
+
+void resetRayCacheStats(RayCache* cache) {
+    cache->reused = 0;
+    cache->traversed = 0;
+}
+
+// returns the share of rays that were answered from the cache since the last reset
+float getRayCacheReuseRatio(const RayCache* cache) {
+    const int total = cache->reused + cache->traversed;
+    return (total > 0) ? (float)cache->reused / (float)total : 0.0f;
+}
+
+// checks if the ray still hits the face of the cell it has hit last time
+// on success, returns true and stores the new distance to the face in distance
+bool intersectCachedFace
+(
+    const RayHit* prev,
+    Vector2 start_pos,
+    Vector2 direction,
+    float tile_size,
+    float max_distance,
+    float* distance
+) {
+    float t;
+    float along;
+    int along_cell;
+    if (prev->side == 0) {
+        if (direction.x == 0.0f) return false;
+        // the ray enters through the left face when moving right and vice versa
+        const int face_x = (direction.x > 0.0f) ? prev->cell_x : prev->cell_x + 1;
+        t = ((float)face_x * tile_size - start_pos.x) / direction.x;
+        along = start_pos.y + direction.y * t;
+        along_cell = prev->cell_y;
+    } else {
+        if (direction.y == 0.0f) return false;
+        const int face_y = (direction.y > 0.0f) ? prev->cell_y : prev->cell_y + 1;
+        t = ((float)face_y * tile_size - start_pos.y) / direction.y;
+        along = start_pos.x + direction.x * t;
+        along_cell = prev->cell_x;
+    }
+
+    if (t <= 0.0f || t >= max_distance) return false;
+    if (along < (float)along_cell * tile_size || along > (float)(along_cell + 1) * tile_size) {
+        return false;
+    }
+
+    *distance = t;
+    return true;
+}
+
+// same as castRayDDAHit, but tries to reuse the hit of ray index from the previous frame
+// the cached cell has to still be a wall, the ray has to still cross its face and the
+// segment up to that face has to be free, otherwise the grid is traversed as usual
+RayHit castRayCached
+(
+    RayCache* cache,
+    // the index of the ray in the cache, should be the same for the same ray every frame
+    int index,
+    Vector2 start_pos,
+    Vector2 direction,
+    int** map,
+    int map_rows,
+    int map_cols,
+    float tile_size,
+    float max_distance,
+    // used for the occlusion check of the segment up to the cached face
+    const OccupancyBlocks* occ
+) {
+    RayHit* prev = &cache->hits[index];
+
+    float distance;
+    if
+    (
+        prev->has_hit_wall &&
+        isWallCell(map, map_rows, map_cols, prev->cell_x, prev->cell_y) &&
+        intersectCachedFace(prev, start_pos, direction, tile_size, max_distance, &distance) &&
+        isSegmentClear(
+            start_pos,
+            direction,
+            // stay clear of the face itself, which would count as entering the wall
+            distance - 0.001f * tile_size,
+            map,
+            map_rows,
+            map_cols,
+            tile_size,
+            occ
+        )
+    ) {
+        cache->reused++;
+        prev->distance = distance;
+        return *prev;
+    }
+
+    cache->traversed++;
+    *prev = castRayDDAHit(start_pos, direction, map, map_rows, map_cols, tile_size, max_distance, LAYER_ALL);
+    return *prev;
+}
+
+// a rectangle of cells from x0/y0 to x1/y1 (inclusive)
+typedef struct MapRect {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+} MapRect;
+
+// allocates a grid of map_rows * map_cols cells that are all marked as open
+int** createMap(int map_rows, int map_cols) {
+    int** map = heapAlloc(sizeof (int*) * map_rows);
+    for (int i = 0; i < map_rows; i++) {
+        map[i] = heapCalloc(map_cols, sizeof (int));
+    }
+    return map;
+}
+
+void destroyMap(int** map, int map_rows) {
+    for (int i = 0; i < map_rows; i++) {
+        heapFree(map[i]);
+    }
+    heapFree(map);
+}
+
+// returns the number of bytes a map from createMap takes up, including the row pointers
+size_t getMapBytes(int map_rows, int map_cols) {
+    return sizeof (int*) * (size_t)map_rows + sizeof (int) * (size_t)map_rows * (size_t)map_cols;
+}
+
+// casts count independent rays and writes their distances to distances
+void castRayBatch
+(
+    const Vector2* origins,
+    // normalized unit vectors
+    const Vector2* directions,
+    int count,
+    int** map,
+    int map_rows,
+    int map_cols,
+    float tile_size,
+    float max_distance,
+    float* distances
+) {
+    for (int i = 0; i < count; i++) {
+        distances[i] = castRayDDA(
+            origins[i],
+            directions[i],
+            map,
+            map_rows,
+            map_cols,
+            tile_size,
+            max_distance
+        );
+    }
+}
+
+// buffers that castRayBatchSorted needs, allocated once and reused for every batch
+typedef struct RayBatchScratch {
+    // the maximum number of rays per batch
+    int capacity;
+    // sort keys and the ray indices they belong to, twice for the radix sort passes
+    uint64_t* keys;
+    uint64_t* keys_tmp;
+    int* order;
+    int* order_tmp;
+    // the rays and results in sorted order
+    Vector2* sorted_origins;
+    Vector2* sorted_directions;
+    float* sorted_distances;
+} RayBatchScratch;
+
+RayBatchScratch createRayBatchScratch(int capacity) {
+    return (RayBatchScratch){
+        .capacity = capacity,
+        .keys = heapAlloc(sizeof (uint64_t) * capacity),
+        .keys_tmp = heapAlloc(sizeof (uint64_t) * capacity),
+        .order = heapAlloc(sizeof (int) * capacity),
+        .order_tmp = heapAlloc(sizeof (int) * capacity),
+        .sorted_origins = heapAlloc(sizeof (Vector2) * capacity),
+        .sorted_directions = heapAlloc(sizeof (Vector2) * capacity),
+        .sorted_distances = heapAlloc(sizeof (float) * capacity),
+    };
+}
+
+// the same as createRayBatchScratch, but the buffers are taken from a frame arena and
+// go away with its next reset instead of destroyRayBatchScratch
+RayBatchScratch allocRayBatchScratch(Arena* arena, int capacity) {
+    return (RayBatchScratch){
+        .capacity = capacity,
+        .keys = allocArena(arena, sizeof (uint64_t) * capacity),
+        .keys_tmp = allocArena(arena, sizeof (uint64_t) * capacity),
+        .order = allocArena(arena, sizeof (int) * capacity),
+        .order_tmp = allocArena(arena, sizeof (int) * capacity),
+        .sorted_origins = allocArena(arena, sizeof (Vector2) * capacity),
+        .sorted_directions = allocArena(arena, sizeof (Vector2) * capacity),
+        .sorted_distances = allocArena(arena, sizeof (float) * capacity),
+    };
+}
+
+void destroyRayBatchScratch(RayBatchScratch* scratch) {
+    heapFree(scratch->keys);
+    heapFree(scratch->keys_tmp);
+    heapFree(scratch->order);
+    heapFree(scratch->order_tmp);
+    heapFree(scratch->sorted_origins);
+    heapFree(scratch->sorted_directions);
+    heapFree(scratch->sorted_distances);
+    *scratch = (RayBatchScratch){ 0 };
+}
+
+// spreads the lower 16 bits of v out so there is a zero bit between each of them
+uint32_t spreadBits16(uint32_t v) {
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+// returns the Morton code (Z-order index) of a cell, cells close to each other on the
+// grid get codes close to each other
+// NOTE: coordinates are clamped to 16 bits, so grids up to 65536 x 65536 cells are
+//       ordered exactly
+uint32_t mortonCode(int cell_x, int cell_y) {
+    const uint32_t x = (uint32_t)((cell_x < 0) ? 0 : (cell_x > 0xffff) ? 0xffff : cell_x);
+    const uint32_t y = (uint32_t)((cell_y < 0) ? 0 : (cell_y > 0xffff) ? 0xffff : cell_y);
+    return spreadBits16(x) | (spreadBits16(y) << 1);
+}
+
+// returns which of the 8 octants a direction points into
+// rays in the same octant have the same step_x and step_y in castRayDDAHit and step
+// along the same major axis, so they take the same branches while traversing
+uint32_t directionOctant(Vector2 direction) {
+    return
+        ((uint32_t)(direction.x < 0.0f) << 2) |
+        ((uint32_t)(direction.y < 0.0f) << 1) |
+        (uint32_t)(fabsf(direction.x) < fabsf(direction.y));
+}
+
+// sorts the indices 0 to count - 1 by direction octant first and by the Morton code of
+// the cell the ray starts in second
+// afterwards, scratch->order holds the ray indices in sorted order
+void sortRaysByCoherence
+(
+    const Vector2* origins,
+    const Vector2* directions,
+    int count,
+    float tile_size,
+    RayBatchScratch* scratch
+) {
+    uint64_t* keys = scratch->keys;
+    uint64_t* keys_tmp = scratch->keys_tmp;
+    int* order = scratch->order;
+    int* order_tmp = scratch->order_tmp;
+
+    for (int i = 0; i < count; i++) {
+        const int cell_x = (int)floorf(origins[i].x / tile_size);
+        const int cell_y = (int)floorf(origins[i].y / tile_size);
+        keys[i] = ((uint64_t)directionOctant(directions[i]) << 32) | mortonCode(cell_x, cell_y);
+        order[i] = i;
+    }
+
+    // least significant digit radix sort with 8 bit digits over the 35 used key bits
+    // passes where every key has the same digit don't change the order and are skipped
+    for (int shift = 0; shift < 40; shift += 8) {
+        int histogram[256] = { 0 };
+        for (int i = 0; i < count; i++) {
+            histogram[(keys[i] >> shift) & 0xff]++;
+        }
+        if (count == 0 || histogram[(keys[0] >> shift) & 0xff] == count) continue;
+
+        int offset = 0;
+        for (int d = 0; d < 256; d++) {
+            const int digit_count = histogram[d];
+            histogram[d] = offset;
+            offset += digit_count;
+        }
+
+        for (int i = 0; i < count; i++) {
+            const int dst = histogram[(keys[i] >> shift) & 0xff]++;
+            keys_tmp[dst] = keys[i];
+            order_tmp[dst] = order[i];
+        }
+
+        uint64_t* swap_keys = keys;
+        keys = keys_tmp;
+        keys_tmp = swap_keys;
+        int* swap_order = order;
+        order = order_tmp;
+        order_tmp = swap_order;
+    }
+
+    // the sorted data may have ended up in the temporary buffers
+    scratch->keys = keys;
+    scratch->keys_tmp = keys_tmp;
+    scratch->order = order;
+    scratch->order_tmp = order_tmp;
+}
+
+// same as castRayBatch, but sorts the rays for coherence before casting them
+// neighbouring rays then step in the same directions through the same part of the
+// grid, which keeps the touched rows in cache when rays come from many random places
+// the distances are scattered back, so they are in the original order of the rays
+// NOTE: count must not exceed scratch->capacity
+void castRayBatchSorted
+(
+    const Vector2* origins,
+    const Vector2* directions,
+    int count,
+    int** map,
+    int map_rows,
+    int map_cols,
+    float tile_size,
+    float max_distance,
+    RayBatchScratch* scratch,
+    float* distances
+) {
+    sortRaysByCoherence(origins, directions, count, tile_size, scratch);
+
+    for (int i = 0; i < count; i++) {
+        scratch->sorted_origins[i] = origins[scratch->order[i]];
+        scratch->sorted_directions[i] = directions[scratch->order[i]];
+    }
+
+    castRayBatch(
+        scratch->sorted_origins,
+        scratch->sorted_directions,
+        count,
+        map,
+        map_rows,
+        map_cols,
+        tile_size,
+        max_distance,
+        scratch->sorted_distances
+    );
+
+    for (int i = 0; i < count; i++) {
+        distances[scratch->order[i]] = scratch->sorted_distances[i];
+    }
+}
+
+// returns the distance from apex to the nearest point of an axis aligned box that lies
+// inside the cone around axis with the given half angle, or INFINITY if the box is
+// completely outside of the cone
+// the nearest point is stored in nearest_pos
+// NOTE: half_angle must not exceed 90 degrees, the cone has to be convex for this to work
+float coneBoxDistance
+(
+    Vector2 apex,
+    // normalized direction of the cone's center line
+    Vector2 axis,
+    float half_angle,
+    Vector2 box_min,
+    Vector2 box_max,
+    Vector2* nearest_pos
+) {
+    if
+    (
+        apex.x >= box_min.x && apex.x <= box_max.x &&
+        apex.y >= box_min.y && apex.y <= box_max.y
+    ) {
+        *nearest_pos = apex;
+        return 0.0f;
+    }
+
+    // the intersection of the box and the cone is convex, so its nearest point is either
+    // the nearest point of the whole box (if that lies inside the cone) or a point on
+    // one of the two edges of the cone
+    const Vector2 closest = {
+        Clamp(apex.x, box_min.x, box_max.x),
+        Clamp(apex.y, box_min.y, box_max.y),
+    };
+    const Vector2 to_closest = Vector2Subtract(closest, apex);
+    const float closest_dist = Vector2Length(to_closest);
+    if (Vector2DotProduct(to_closest, axis) >= cosf(half_angle) * closest_dist) {
+        *nearest_pos = closest;
+        return closest_dist;
+    }
+
+    float best = INFINITY;
+    for (int edge = -1; edge <= 1; edge += 2) {
+        const Vector2 dir = Vector2Rotate(axis, (float)edge * half_angle);
+
+        // slab test, the inverse is infinite for axis aligned edges, which min/max handle
+        const Vector2 inv = { 1.0f / dir.x, 1.0f / dir.y };
+        const float tx0 = (box_min.x - apex.x) * inv.x;
+        const float tx1 = (box_max.x - apex.x) * inv.x;
+        const float ty0 = (box_min.y - apex.y) * inv.y;
+        const float ty1 = (box_max.y - apex.y) * inv.y;
+        const float t_enter = fmaxf(fminf(tx0, tx1), fminf(ty0, ty1));
+        const float t_exit = fminf(fmaxf(tx0, tx1), fmaxf(ty0, ty1));
+
+        if (t_enter <= t_exit && t_enter >= 0.0f && t_enter < best) {
+            best = t_enter;
+            *nearest_pos = Vector2Add(apex, Vector2Scale(dir, t_enter));
+        }
+    }
+
+    return best;
+}
+
+// same as coneBoxDistance, but for the solid half of the slope cell at cell_x/cell_y
+// the nearest point of the half is used if it lies inside the cone, otherwise both edges
+// of the cone are tested against the half with intersectSlopeCell, like a ray would be
+// NOTE: half_angle must not exceed 90 degrees, the cone has to be convex for this to work
+float coneSlopeDistance
+(
+    Vector2 apex,
+    // normalized direction of the cone's center line
+    Vector2 axis,
+    float half_angle,
+    int cell,
+    int cell_x,
+    int cell_y,
+    float tile_size,
+    Vector2* nearest_pos
+) {
+    const int shape = (cell >> CELL_SHAPE_SHIFT) - SHAPE_SLOPE_NW;
+    const float* plane = slope_planes[shape];
+
+    // the apex is inside the solid half
+    const float apex_u = apex.x / tile_size - (float)cell_x;
+    const float apex_v = apex.y / tile_size - (float)cell_y;
+    if
+    (
+        apex_u >= 0.0f && apex_u <= 1.0f && apex_v >= 0.0f && apex_v <= 1.0f &&
+        plane[0] * apex_u + plane[1] * apex_v + plane[2] >= 0.0f
+    ) {
+        *nearest_pos = apex;
+        return 0.0f;
+    }
+
+    // the nearest point of the triangle lies on one of its edges
+    Vector2 corners[3];
+    for (int i = 0; i < 3; i++) {
+        corners[i] = (Vector2){
+            ((float)cell_x + slope_corners[shape][i][0]) * tile_size,
+            ((float)cell_y + slope_corners[shape][i][1]) * tile_size,
+        };
+    }
+    Vector2 closest = corners[0];
+    float closest_dist = INFINITY;
+    for (int i = 0; i < 3; i++) {
+        const Vector2 a = corners[i];
+        const Vector2 edge = Vector2Subtract(corners[(i + 1) % 3], a);
+        const float t = Clamp(Vector2DotProduct(Vector2Subtract(apex, a), edge) / Vector2DotProduct(edge, edge), 0.0f, 1.0f);
+        const Vector2 point = Vector2Add(a, Vector2Scale(edge, t));
+        const float dist = Vector2Distance(apex, point);
+        if (dist < closest_dist) {
+            closest = point;
+            closest_dist = dist;
+        }
+    }
+    if (Vector2DotProduct(Vector2Subtract(closest, apex), axis) >= cosf(half_angle) * closest_dist) {
+        *nearest_pos = closest;
+        return closest_dist;
+    }
+
+    const Vector2 box_min = { (float)cell_x * tile_size, (float)cell_y * tile_size };
+    const Vector2 box_max = { box_min.x + tile_size, box_min.y + tile_size };
+
+    float best = INFINITY;
+    for (int edge = -1; edge <= 1; edge += 2) {
+        const Vector2 dir = Vector2Rotate(axis, (float)edge * half_angle);
+
+        // where the edge is inside the cell, see coneBoxDistance
+        const Vector2 inv = { 1.0f / dir.x, 1.0f / dir.y };
+        const float tx0 = (box_min.x - apex.x) * inv.x;
+        const float tx1 = (box_max.x - apex.x) * inv.x;
+        const float ty0 = (box_min.y - apex.y) * inv.y;
+        const float ty1 = (box_max.y - apex.y) * inv.y;
+        const float t_enter = fmaxf(fmaxf(fminf(tx0, tx1), fminf(ty0, ty1)), 0.0f);
+        const float t_exit = fminf(fmaxf(tx0, tx1), fmaxf(ty0, ty1));
+        if (t_enter > t_exit) continue;
+
+        float t;
+        if
+        (
+            intersectSlopeCell(cell, apex, dir, cell_x, cell_y, tile_size, t_enter, t_exit, &t) &&
+            t < best
+        ) {
+            best = t;
+            *nearest_pos = Vector2Add(apex, Vector2Scale(dir, t));
+        }
+    }
+
+    return best;
+}
+
+// checks if any wall lies inside the wedge (circle sector) around direction with the
+// given half angle and radius range, which is what AI perception usually asks for
+// instead of casting dozens of rays, every cell the wedge touches is looked at once:
+// the wedge is enclosed by a slightly larger polygon and the cells of each row are only
+// visited between the leftmost and rightmost point of that polygon inside the row
+// if nearest is not NULL, the full wedge is searched and nearest receives the wall cell
+// with the closest point to origin, whose position is stored in nearest_pos
+// if nearest is NULL, the query stops at the first wall that is found
+// only cells with a layer of layer_mask count as walls, slopes only with their solid half
+// NOTE: half_angle must not exceed 90 degrees
+bool queryWedge
+(
+    Vector2 origin,
+    // normalized direction of the wedge's center line
+    Vector2 direction,
+    float half_angle,
+    float range,
+    int** map,
+    int map_rows,
+    int map_cols,
+    float tile_size,
+    // the layers that count as walls, see LAYER_VISION
+    int layer_mask,
+    RayHit* nearest,
+    // may be NULL
+    Vector2* nearest_pos
+) {
+    // the outline of the wedge, the arc is approximated with segments whose corners lie
+    // a bit further out than range, so the polygon contains the whole arc
+    enum { ARC_SEGMENTS = 8 };
+    const float segment_angle = 2.0f * half_angle / (float)ARC_SEGMENTS;
+    const float outer_radius = range / cosf(0.5f * segment_angle);
+
+    Vector2 outline[ARC_SEGMENTS + 3];
+    int outline_count = 0;
+    outline[outline_count++] = origin;
+    outline[outline_count++] = Vector2Add(
+        origin,
+        Vector2Scale(Vector2Rotate(direction, -half_angle), range)
+    );
+    for (int i = 0; i < ARC_SEGMENTS; i++) {
+        const float angle = -half_angle + ((float)i + 0.5f) * segment_angle;
+        outline[outline_count++] = Vector2Add(
+            origin,
+            Vector2Scale(Vector2Rotate(direction, angle), outer_radius)
+        );
+    }
+    outline[outline_count++] = Vector2Add(
+        origin,
+        Vector2Scale(Vector2Rotate(direction, half_angle), range)
+    );
+
+    float min_y = origin.y;
+    float max_y = origin.y;
+    for (int i = 1; i < outline_count; i++) {
+        min_y = fminf(min_y, outline[i].y);
+        max_y = fmaxf(max_y, outline[i].y);
+    }
+
+    int row_begin = (int)floorf(min_y / tile_size);
+    int row_end = (int)floorf(max_y / tile_size);
+    if (row_begin < 0) row_begin = 0;
+    if (row_end > map_rows - 1) row_end = map_rows - 1;
+
+    bool found = false;
+    float best = INFINITY;
+
+    for (int row = row_begin; row <= row_end; row++) {
+        const float strip_y0 = (float)row * tile_size;
+        const float strip_y1 = strip_y0 + tile_size;
+
+        // find the horizontal extent of the outline inside this row by clipping each
+        // of its edges against the strip
+        float span_x0 = INFINITY;
+        float span_x1 = -INFINITY;
+        for (int i = 0; i < outline_count; i++) {
+            const Vector2 a = outline[i];
+            const Vector2 b = outline[(i + 1) % outline_count];
+            float t0 = 0.0f;
+            float t1 = 1.0f;
+            if (a.y == b.y) {
+                if (a.y < strip_y0 || a.y > strip_y1) continue;
+            } else {
+                float ta = (strip_y0 - a.y) / (b.y - a.y);
+                float tb = (strip_y1 - a.y) / (b.y - a.y);
+                if (ta > tb) {
+                    const float tmp = ta;
+                    ta = tb;
+                    tb = tmp;
+                }
+                t0 = fmaxf(t0, ta);
+                t1 = fminf(t1, tb);
+                if (t0 > t1) continue;
+            }
+            const float x0 = a.x + (b.x - a.x) * t0;
+            const float x1 = a.x + (b.x - a.x) * t1;
+            span_x0 = fminf(span_x0, fminf(x0, x1));
+            span_x1 = fmaxf(span_x1, fmaxf(x0, x1));
+        }
+        if (span_x0 > span_x1) continue;
+
+        int col_begin = (int)floorf(span_x0 / tile_size);
+        int col_end = (int)floorf(span_x1 / tile_size);
+        if (col_begin < 0) col_begin = 0;
+        if (col_end > map_cols - 1) col_end = map_cols - 1;
+
+        for (int col = col_begin; col <= col_end; col++) {
+            const int cell = map[row][col];
+            if ((cell & layer_mask) == 0) continue;
+
+            const Vector2 box_min = { (float)col * tile_size, strip_y0 };
+            const Vector2 box_max = { box_min.x + tile_size, strip_y1 };
+            Vector2 point;
+            const bool is_slope = (cell >> CELL_SHAPE_SHIFT) != SHAPE_FULL;
+            float dist;
+            if (is_slope) {
+                dist = coneSlopeDistance(origin, direction, half_angle, cell, col, row, tile_size, &point);
+            } else {
+                dist = coneBoxDistance(origin, direction, half_angle, box_min, box_max, &point);
+            }
+            if (dist > range || dist >= best) continue;
+
+            // a point on the left or right face of the cell was reached through a vertical
+            // grid line, a point inside a slope cell lies on its diagonal
+            int side = 1;
+            if (point.x == box_min.x || point.x == box_max.x) {
+                side = 0;
+            } else if (is_slope && point.y != box_min.y && point.y != box_max.y) {
+                side = SIDE_SLOPE;
+            }
+
+            found = true;
+            if (nearest == NULL) return true;
+
+            best = dist;
+            *nearest = (RayHit){
+                .distance = dist,
+                .cell_x = col,
+                .cell_y = row,
+                .side = side,
+                .has_hit_wall = true,
+            };
+            if (nearest_pos != NULL) *nearest_pos = point;
+        }
+    }
+
+    return found;
+}
+
+// checks if a round target is inside the view cone of an observer and not fully
+// hidden behind walls, only cells with a layer of layer_mask hide it
+// the center and both sides of the target are tested with a single ray each
+bool isTargetVisible
+(
+    Vector2 observer_pos,
+    // normalized direction the observer is facing
+    Vector2 facing,
+    float half_angle,
+    float range,
+    Vector2 target_pos,
+    float target_radius,
+    int** map,
+    int map_rows,
+    int map_cols,
+    float tile_size,
+    // the layers that block sight, usually LAYER_VISION
+    int layer_mask
+) {
+    const Vector2 to_target = Vector2Subtract(target_pos, observer_pos);
+    const float target_dist = Vector2Length(to_target);
+    if (target_dist - target_radius > range) return false;
+    if (target_dist <= target_radius) return true;
+
+    // widen the cone by the angle the target covers, so a partly visible target counts
+    const float target_angle = asinf(target_radius / target_dist);
+    const Vector2 target_dir = Vector2Scale(to_target, 1.0f / target_dist);
+    if (Vector2DotProduct(target_dir, facing) < cosf(fminf(half_angle + target_angle, PI))) {
+        return false;
+    }
+
+    for (int i = -1; i <= 1; i++) {
+        const float angle = (float)i * 0.95f * target_angle;
+        const float visible = castRayDDAHit(
+            observer_pos,
+            Vector2Rotate(target_dir, angle),
+            map,
+            map_rows,
+            map_cols,
+            tile_size,
+            target_dist,
+            layer_mask
+        ).distance;
+        if (visible >= target_dist - target_radius) return true;
+    }
+
+    return false;
+}
+
+// the work done by parallelFor on the index range [begin, end)
+typedef void (*ParallelTask)(void* ctx, int begin, int end);
+
+// one contiguous range of indices handed to a worker thread
+typedef struct ParallelBand {
+    ParallelTask task;
+    void* ctx;
+    int begin;
+    int end;
+} ParallelBand;
+
+#define MAX_WORKERS 16
+
+// when set, parallelFor runs band i on a thread that is pinned to the i-th cpu the
+// process may run on, so the same rows always end up on the same core, and with first
+// touch (see createMapLarge) on the memory of that core's NUMA node
+bool pin_worker_threads = false;
+
+void* runParallelBand(void* arg) {
+    ParallelBand* band = arg;
+    band->task(band->ctx, band->begin, band->end);
+    return NULL;
+}
+
+// returns the number of threads parallelFor splits its work across
+int getWorkerCount(void) {
+#ifdef __linux__
+    // under taskset or a cgroup cpuset the process may only run on some of the cpus
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof allowed, &allowed) == 0) {
+        const int allowed_count = CPU_COUNT(&allowed);
+        if (allowed_count < 1) return 1;
+        return (allowed_count > MAX_WORKERS) ? MAX_WORKERS : allowed_count;
+    }
+#endif
+    const long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count < 1) return 1;
+    return (cpu_count > MAX_WORKERS) ? MAX_WORKERS : (int)cpu_count;
+}
+
+#ifdef __linux__
+// returns the index-th cpu in allowed, or -1 if there are not that many
+int getAllowedCpu(const cpu_set_t* allowed, int index) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, allowed)) continue;
+        if (index == 0) return cpu;
+        index--;
+    }
+    return -1;
+}
+#endif
+
+// splits the indices [0, count) into one band per worker and runs task on all bands in
+// parallel, the calling thread works on the first band itself
+// bands are never smaller than min_band indices, so small jobs stay on one thread
+void parallelFor(int count, int min_band, ParallelTask task, void* ctx) {
+    int workers = getWorkerCount();
+    if (min_band < 1) min_band = 1;
+    if (workers > count / min_band) workers = count / min_band;
+    if (workers <= 1) {
+        task(ctx, 0, count);
+        return;
+    }
+
+    ParallelBand bands[MAX_WORKERS];
+    pthread_t threads[MAX_WORKERS];
+    bool started[MAX_WORKERS] = { false };
+    for (int i = 0; i < workers; i++) {
+        bands[i] = (ParallelBand){
+            .task = task,
+            .ctx = ctx,
+            .begin = (int)((long long)count * i / workers),
+            .end = (int)((long long)count * (i + 1) / workers),
+        };
+    }
+
+    // pinned, the first band gets its own thread as well, since the calling thread can be
+    // on any core
+    const int first_thread = pin_worker_threads ? 0 : 1;
+#ifdef __linux__
+    cpu_set_t allowed;
+    const bool has_allowed = pin_worker_threads && sched_getaffinity(0, sizeof allowed, &allowed) == 0;
+#endif
+    for (int i = first_thread; i < workers; i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        // NOTE: thread affinity is only available on linux, elsewhere pinning just means
+        // that the first band gets its own thread too
+#ifdef __linux__
+        const int cpu = (pin_worker_threads && has_allowed) ? getAllowedCpu(&allowed, i) : -1;
+        if (cpu >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(cpu, &cpus);
+            pthread_attr_setaffinity_np(&attr, sizeof cpus, &cpus);
+        }
+#endif
+        started[i] = pthread_create(&threads[i], &attr, runParallelBand, &bands[i]) == 0;
+        pthread_attr_destroy(&attr);
+        // the affinity can still be refused, then the thread just runs unpinned
+        if (!started[i] && pin_worker_threads) {
+            started[i] = pthread_create(&threads[i], NULL, runParallelBand, &bands[i]) == 0;
+        }
+        // if no thread can be started, the band is simply worked on right here
+        if (!started[i]) runParallelBand(&bands[i]);
+    }
+    if (first_thread > 0) runParallelBand(&bands[0]);
+    for (int i = first_thread; i < workers; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+}
+
+// the rows of a map from createMapLarge that still have to be touched
+typedef struct MapTouch {
+    int** map;
+    int map_cols;
+} MapTouch;
+
+void touchMapRows(void* ctx, int begin, int end) {
+    MapTouch* touch = ctx;
+    for (int y = begin; y < end; y++) memset(touch->map[y], 0, sizeof (int) * touch->map_cols);
+}
+
+// the same as createMap, but all cells are in one LargeBlock, optionally backed by huge
+// pages, and are first touched by the parallelFor workers so each band of rows is placed
+// on the NUMA node of the worker that wrote it
+// returns NULL if the block can't be mapped, free the map with destroyMapLarge
+int** createMapLarge(int map_rows, int map_cols, bool use_huge_pages, LargeBlock* block) {
+    *block = allocLargeBlock(sizeof (int) * (size_t)map_rows * (size_t)map_cols, use_huge_pages);
+    if (block->bytes == NULL) return NULL;
+
+    int** map = heapAlloc(sizeof (int*) * map_rows);
+    for (int i = 0; i < map_rows; i++) map[i] = (int*)block->bytes + (size_t)i * (size_t)map_cols;
+
+    MapTouch touch = { .map = map, .map_cols = map_cols };
+    parallelFor(map_rows, 64, touchMapRows, &touch);
+    return map;
+}
+
+void destroyMapLarge(int** map, LargeBlock* block) {
+    heapFree(map);
+    freeLargeBlock(block);
+}
+
+// a batch of rays for castRayBatchParallel, see castRayBatch
+typedef struct RayBatchJob {
+    const Vector2* origins;
+    const Vector2* directions;
+    int** map;
+    int map_rows;
+    int map_cols;
+    float tile_size;
+    float max_distance;
+    float* distances;
+} RayBatchJob;
+
+void castRayBatchBand(void* ctx, int begin, int end) {
+    const RayBatchJob* job = ctx;
+    castRayBatch(
+        &job->origins[begin],
+        &job->directions[begin],
+        end - begin,
+        job->map,
+        job->map_rows,
+        job->map_cols,
+        job->tile_size,
+        job->max_distance,
+        &job->distances[begin]
+    );
+}
+
+// castRayBatch split across the parallelFor workers
+void castRayBatchParallel
+(
+    const Vector2* origins,
+    const Vector2* directions,
+    int count,
+    int** map,
+    int map_rows,
+    int map_cols,
+    float tile_size,
+    float max_distance,
+    float* distances
+) {
+    RayBatchJob job = {
+        .origins = origins,
+        .directions = directions,
+        .map = map,
+        .map_rows = map_rows,
+        .map_cols = map_cols,
+        .tile_size = tile_size,
+        .max_distance = max_distance,
+        .distances = distances,
+    };
+    parallelFor(count, 1024, castRayBatchBand, &job);
+}
+
+// the euclidean distance from every cell to the nearest wall cell, measured between
+// cell centers in cells, together with which wall cell that is
+// exact after buildDistanceField, the incremental updates can leave a few cells with a
+// wall that is slightly farther (see updateDistanceFieldRects)
+typedef struct DistanceField {
+    int rows;
+    int cols;
+    // squared distance to the nearest wall, INFINITY if the map has no walls
+    // NOTE: beyond 2^24 (a distance of 4096 cells) the float is rounded, the site is
+    //       not and the queries measure from it
+    float* dist_sq;
+    // index (row * cols + col) of the nearest wall cell, -1 if the map has no walls
+    // NOTE: an int, so the field covers maps of up to 2^31 cells
+    int* site;
+    // work queue for incremental updates, grows as needed
+    int* queue;
+    int queue_capacity;
+} DistanceField;
+
+// state shared by the passes of buildDistanceField
+typedef struct DistanceFieldPass {
+    DistanceField* df;
+    int** map;
+} DistanceFieldPass;
+
+// first pass: distance to the nearest wall in the same column
+void distanceFieldColumns(void* ctx, int begin, int end) {
+    DistanceFieldPass* pass = ctx;
+    DistanceField* df = pass->df;
+
+    for (int x = begin; x < end; x++) {
+        int last = -1;
+        for (int y = 0; y < df->rows; y++) {
+            if (pass->map[y][x] != 0) last = y;
+            const int i = y * df->cols + x;
+            df->dist_sq[i] = (last >= 0) ? (float)((double)(y - last) * (double)(y - last)) : INFINITY;
+            df->site[i] = (last >= 0) ? last * df->cols + x : -1;
+        }
+
+        last = -1;
+        for (int y = df->rows - 1; y >= 0; y--) {
+            if (pass->map[y][x] != 0) last = y;
+            const int i = y * df->cols + x;
+            if (last >= 0 && (df->site[i] < 0 || last - y < y - df->site[i] / df->cols)) {
+                df->dist_sq[i] = (float)((double)(last - y) * (double)(last - y));
+                df->site[i] = last * df->cols + x;
+            }
+        }
+    }
+}
+
+// second pass: the lower envelope of parabolas along each row, see Felzenszwalb and
+// Huttenlocher, "Distance Transforms of Sampled Functions"
+// every parabola is rooted at a cell and has the column distance of that cell as its
+// height, the lowest parabola above a cell gives the distance to the nearest wall
+// the envelope is computed in doubles from the column distances of the sites, which are
+// exact for any map size, floats and ints lose the squares of large maps
+void distanceFieldRows(void* ctx, int begin, int end) {
+    DistanceFieldPass* pass = ctx;
+    DistanceField* df = pass->df;
+    const int n = df->cols;
+
+    double* f = heapAlloc(sizeof (double) * n);
+    int* f_site = heapAlloc(sizeof (int) * n);
+    // the roots of the parabolas of the envelope and where each one starts
+    int* v = heapAlloc(sizeof (int) * n);
+    double* z = heapAlloc(sizeof (double) * (n + 1));
+
+    for (int y = begin; y < end; y++) {
+        float* row_dist = &df->dist_sq[(size_t)y * n];
+        int* row_site = &df->site[(size_t)y * n];
+        memcpy(f_site, row_site, sizeof (int) * n);
+        for (int q = 0; q < n; q++) {
+            const double dy = (double)(y - f_site[q] / n);
+            f[q] = (f_site[q] >= 0) ? dy * dy : INFINITY;
+        }
+
+        // cells without any wall in their column don't have a parabola
+        int k = -1;
+        for (int q = 0; q < n; q++) {
+            if (f[q] == INFINITY) continue;
+            if (k < 0) {
+                k = 0;
+                v[0] = q;
+                z[0] = -INFINITY;
+                z[1] = INFINITY;
+                continue;
+            }
+
+            // drop the parabolas that the new one lies below of everywhere they are
+            // part of the envelope, z[0] is -INFINITY so the first one always stays
+            double s;
+            while (true) {
+                const int p = v[k];
+                s = ((f[q] + (double)q * q) - (f[p] + (double)p * p)) / (2.0 * (double)(q - p));
+                if (s > z[k]) break;
+                k--;
+            }
+            k++;
+            v[k] = q;
+            z[k] = s;
+            z[k + 1] = INFINITY;
+        }
+        if (k < 0) continue;
+
+        k = 0;
+        for (int q = 0; q < n; q++) {
+            while (z[k + 1] < (double)q) k++;
+            const int p = v[k];
+            row_dist[q] = (float)((double)(q - p) * (double)(q - p) + f[p]);
+            row_site[q] = f_site[p];
+        }
+    }
+
+    heapFree(z);
+    heapFree(v);
+    heapFree(f_site);
+    heapFree(f);
+}
+
+// (re)computes the whole distance field from the map, the rows and columns are split
+// across worker threads
+void buildDistanceField(DistanceField* df, int** map) {
+    DistanceFieldPass pass = { .df = df, .map = map };
+    parallelFor(df->cols, 64, distanceFieldColumns, &pass);
+    parallelFor(df->rows, 64, distanceFieldRows, &pass);
+}
+
+DistanceField createDistanceField(int** map, int map_rows, int map_cols) {
+    DistanceField df = {
+        .rows = map_rows,
+        .cols = map_cols,
+        .dist_sq = heapAlloc(sizeof (float) * map_rows * map_cols),
+        .site = heapAlloc(sizeof (int) * map_rows * map_cols),
+        .queue = NULL,
+        .queue_capacity = 0,
+    };
+    buildDistanceField(&df, map);
+    return df;
+}
+
+void destroyDistanceField(DistanceField* df) {
+    heapFree(df->dist_sq);
+    heapFree(df->site);
+    heapFree(df->queue);
+    *df = (DistanceField){ 0 };
+}
+
+// returns the number of bytes of the distance field, including the update queue
+size_t getDistanceFieldBytes(const DistanceField* df) {
+    return
+        (sizeof (float) + sizeof (int)) * (size_t)df->rows * (size_t)df->cols +
+        sizeof (int) * (size_t)df->queue_capacity;
+}
+
+// returns the squared distance between the centers of two cells given by index
+float cellDistanceSq(const DistanceField* df, int a, int b) {
+    const double dx = (double)(a % df->cols - b % df->cols);
+    const double dy = (double)(a / df->cols - b / df->cols);
+    return (float)(dx * dx + dy * dy);
+}
+
+void pushDistanceFieldQueue(DistanceField* df, int* count, int cell) {
+    if (*count == df->queue_capacity) {
+        df->queue_capacity = (df->queue_capacity > 0) ? df->queue_capacity * 2 : 256;
+        df->queue = heapRealloc(df->queue, sizeof (int) * df->queue_capacity);
+    }
+    df->queue[(*count)++] = cell;
+}
+
+// spreads the nearest wall of every queued cell to its neighbours until nothing
+// improves anymore
+// NOTE: propagating through neighbours is not exact in every configuration, the error
+//       stays well below one cell though, a full build is always exact
+void propagateDistanceField(DistanceField* df, int count) {
+    for (int head = 0; head < count; head++) {
+        const int cell = df->queue[head];
+        const int site = df->site[cell];
+        if (site < 0) continue;
+
+        const int x = cell % df->cols;
+        const int y = cell / df->cols;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                const int nx = x + dx;
+                const int ny = y + dy;
+                if (nx < 0 || nx >= df->cols || ny < 0 || ny >= df->rows) continue;
+
+                const int neighbour = ny * df->cols + nx;
+                const float d = cellDistanceSq(df, neighbour, site);
+                if (d < df->dist_sq[neighbour]) {
+                    df->dist_sq[neighbour] = d;
+                    df->site[neighbour] = site;
+                    pushDistanceFieldQueue(df, &count, neighbour);
+                }
+            }
+        }
+    }
+}
+
+// updates the distance field after any of the cells inside the rectangles have changed
+// only the cells whose nearest wall changes are touched
+// NOTE: all removed walls are cleared before anything is spread again, clearing them one
+//       at a time lets a wall that is already gone spread into the region of another one
+// NOTE: the result is not exact, the sites are spread through neighbours (see
+//       propagateDistanceField) so a few cells can keep a wall that is slightly farther
+//       than their nearest one, only buildDistanceField is exact
+//       queryNearestWall still finds the nearest wall, it only uses the site as a bound
+void updateDistanceFieldRects(DistanceField* df, int** map, const MapRect* rects, int rect_count) {
+    int count = 0;
+
+    // every cell that used to be closest to a removed wall forgets about it
+    // these cells form one connected region around each removed wall
+    for (int r = 0; r < rect_count; r++) {
+        for (int y = rects[r].y0; y <= rects[r].y1; y++) {
+            for (int x = rects[r].x0; x <= rects[r].x1; x++) {
+                const int cell = y * df->cols + x;
+                if (map[y][x] != 0 || df->site[cell] != cell) continue;
+                df->dist_sq[cell] = INFINITY;
+                df->site[cell] = -1;
+                pushDistanceFieldQueue(df, &count, cell);
+            }
+        }
+    }
+    for (int head = 0; head < count; head++) {
+        const int cx = df->queue[head] % df->cols;
+        const int cy = df->queue[head] / df->cols;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                const int nx = cx + dx;
+                const int ny = cy + dy;
+                if (nx < 0 || nx >= df->cols || ny < 0 || ny >= df->rows) continue;
+
+                const int neighbour = ny * df->cols + nx;
+                const int site = df->site[neighbour];
+                if (site < 0 || map[site / df->cols][site % df->cols] != 0) continue;
+                df->dist_sq[neighbour] = INFINITY;
+                df->site[neighbour] = -1;
+                pushDistanceFieldQueue(df, &count, neighbour);
+            }
+        }
+    }
+
+    // the cells around the cleared regions still know their nearest wall, spreading it
+    // back inwards fills the regions again
+    const int cleared = count;
+    for (int i = 0; i < cleared; i++) {
+        const int cx = df->queue[i] % df->cols;
+        const int cy = df->queue[i] / df->cols;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                const int nx = cx + dx;
+                const int ny = cy + dy;
+                if (nx < 0 || nx >= df->cols || ny < 0 || ny >= df->rows) continue;
+
+                const int neighbour = ny * df->cols + nx;
+                if (df->site[neighbour] >= 0) pushDistanceFieldQueue(df, &count, neighbour);
+            }
+        }
+    }
+
+    // a new wall can only bring other cells closer to a wall
+    for (int r = 0; r < rect_count; r++) {
+        for (int y = rects[r].y0; y <= rects[r].y1; y++) {
+            for (int x = rects[r].x0; x <= rects[r].x1; x++) {
+                const int cell = y * df->cols + x;
+                if (map[y][x] == 0 || df->site[cell] == cell) continue;
+                df->dist_sq[cell] = 0.0f;
+                df->site[cell] = cell;
+                pushDistanceFieldQueue(df, &count, cell);
+            }
+        }
+    }
+
+    if (count == cleared) return;
+    memmove(df->queue, &df->queue[cleared], sizeof (int) * (count - cleared));
+    propagateDistanceField(df, count - cleared);
+}
+
+// updates the distance field after the cell at x/y of the map has changed
+void updateDistanceField(DistanceField* df, int** map, int x, int y) {
+    const MapRect rect = { .x0 = x, .y0 = y, .x1 = x, .y1 = y };
+    updateDistanceFieldRects(df, map, &rect, 1);
+}
+
+// finds the wall cell closest to pos within radius and the exact closest point on it
+// the distance field only gives an upper bound here: the site of the cell pos lies in
+// bounds the distance, then every cell whose square could be closer than that is checked
+// returns false if there is no wall within radius
+bool queryNearestWall
+(
+    const DistanceField* df,
+    Vector2 pos,
+    // NOTE: the query scans a box of (2 * d / tile_size + 2)^2 cells, with d the smaller
+    //       of radius and the distance to the site, so its cost grows with the square of
+    //       the distance to the nearest wall, a small radius keeps it cheap in open space
+    float radius,
+    float tile_size,
+    // receives the wall cell and the distance to it, side is not used
+    RayHit* nearest,
+    // receives the closest point on the wall cell
+    Vector2* nearest_pos
+) {
+    int cell_x = (int)floorf(pos.x / tile_size);
+    int cell_y = (int)floorf(pos.y / tile_size);
+    if (cell_x < 0) cell_x = 0;
+    if (cell_x > df->cols - 1) cell_x = df->cols - 1;
+    if (cell_y < 0) cell_y = 0;
+    if (cell_y > df->rows - 1) cell_y = df->rows - 1;
+
+    const int center_site = df->site[cell_y * df->cols + cell_x];
+    if (center_site < 0) return false;
+
+    // the site of the center cell is a wall, so the nearest one is at most this far
+    float best = radius;
+    {
+        const int site_x = center_site % df->cols;
+        const int site_y = center_site / df->cols;
+        const Vector2 closest = {
+            Clamp(pos.x, (float)site_x * tile_size, (float)(site_x + 1) * tile_size),
+            Clamp(pos.y, (float)site_y * tile_size, (float)(site_y + 1) * tile_size),
+        };
+        const float dist = Vector2Distance(pos, closest);
+        if (dist < best) best = dist;
+    }
+
+    // a cell whose far edge lies exactly at pos - best still counts
+    const int min_x = (int)Clamp(ceilf((pos.x - best) / tile_size) - 1.0f, 0.0f, (float)(df->cols - 1));
+    const int max_x = (int)Clamp(floorf((pos.x + best) / tile_size), 0.0f, (float)(df->cols - 1));
+    const int min_y = (int)Clamp(ceilf((pos.y - best) / tile_size) - 1.0f, 0.0f, (float)(df->rows - 1));
+    const int max_y = (int)Clamp(floorf((pos.y + best) / tile_size), 0.0f, (float)(df->rows - 1));
+
+    bool found = false;
+    for (int y = min_y; y <= max_y; y++) {
+        for (int x = min_x; x <= max_x; x++) {
+            // a wall cell is its own site
+            const int i = y * df->cols + x;
+            if (df->site[i] != i) continue;
+
+            const Vector2 closest = {
+                Clamp(pos.x, (float)x * tile_size, (float)(x + 1) * tile_size),
+                Clamp(pos.y, (float)y * tile_size, (float)(y + 1) * tile_size),
+            };
+            const float dist = Vector2Distance(pos, closest);
+            if (dist > best || (found && dist == best)) continue;
+
+            found = true;
+            best = dist;
+            *nearest = (RayHit){
+                .distance = dist,
+                .cell_x = x,
+                .cell_y = y,
+                .side = 0,
+                .has_hit_wall = true,
+            };
+            *nearest_pos = closest;
+        }
+    }
+
+    return found;
+}
+
+// an integral image (summed-area table) of the walls on the map, which counts the walls
+// inside any rectangle with a few reads
+// a single table over the whole map would need an update of everything below and to
+// the right of an edited cell, so the table is split into square chunks instead:
+// every chunk has its own table, and three small tables sum up the chunks before it
+// painting one cell rebuilds the table of its chunk, the row and column prefixes of the
+// chunks right of and below it and the chunk corners below and right of it, so the cost
+// grows with the number of chunks (up to (chunk_rows + 1) * (chunk_cols + 1) corners for
+// an edit in the top left chunk) but not with the number of cells like a single table
+typedef struct SummedAreaTable {
+    // the size of the map in cells
+    int rows;
+    int cols;
+    // the side length of one chunk in cells, always a power of two so cell coordinates
+    // can be split into chunk and local coordinates with shifts and masks
+    int chunk_size;
+    int chunk_shift;
+    // the number of chunks in each direction
+    int chunk_rows;
+    int chunk_cols;
+    // per chunk, the number of walls in the chunk above and left of each local corner
+    // (chunk_size + 1)^2 values per chunk, chunks are stored row by row
+    int* local;
+    // the number of walls in all chunks above and left of each chunk corner
+    // (chunk_rows + 1) * (chunk_cols + 1) values
+    int* chunk_prefix;
+    // per chunk row, the walls in the chunks left of a chunk above each local row line
+    // chunk_rows * (chunk_cols + 1) * (chunk_size + 1) values
+    int* row_prefix;
+    // per chunk column, the walls in the chunks above a chunk left of each local column
+    // line, chunk_cols * (chunk_rows + 1) * (chunk_size + 1) values
+    int* col_prefix;
+} SummedAreaTable;
+
+int* getSummedAreaLocal(const SummedAreaTable* sat, int chunk_x, int chunk_y) {
+    const int stride = (sat->chunk_size + 1) * (sat->chunk_size + 1);
+    return &sat->local[(chunk_y * sat->chunk_cols + chunk_x) * stride];
+}
+
+int* getSummedAreaRowPrefix(const SummedAreaTable* sat, int chunk_x, int chunk_y) {
+    return &sat->row_prefix[(chunk_y * (sat->chunk_cols + 1) + chunk_x) * (sat->chunk_size + 1)];
+}
+
+int* getSummedAreaColPrefix(const SummedAreaTable* sat, int chunk_x, int chunk_y) {
+    return &sat->col_prefix[(chunk_x * (sat->chunk_rows + 1) + chunk_y) * (sat->chunk_size + 1)];
+}
+
+// recomputes the local table of one chunk from the map
+void buildSummedAreaChunk(SummedAreaTable* sat, int** map, int cx, int cy) {
+    const int b = sat->chunk_size;
+    int* local = getSummedAreaLocal(sat, cx, cy);
+
+    for (int ly = 0; ly <= b; ly++) {
+        for (int lx = 0; lx <= b; lx++) {
+            int sum = 0;
+            if (lx > 0 && ly > 0) {
+                const int x = cx * b + lx - 1;
+                const int y = cy * b + ly - 1;
+                sum =
+                    ((x < sat->cols && y < sat->rows && map[y][x] != 0) ? 1 : 0) +
+                    local[ly * (b + 1) + lx - 1] +
+                    local[(ly - 1) * (b + 1) + lx] -
+                    local[(ly - 1) * (b + 1) + lx - 1];
+            }
+            local[ly * (b + 1) + lx] = sum;
+        }
+    }
+}
+
+// recomputes the row prefixes of chunk row cy, starting at chunk column from_cx
+void buildSummedAreaRowPrefix(SummedAreaTable* sat, int cy, int from_cx) {
+    const int b = sat->chunk_size;
+
+    if (from_cx == 0) {
+        for (int ly = 0; ly <= b; ly++) getSummedAreaRowPrefix(sat, 0, cy)[ly] = 0;
+    }
+    for (int cx = from_cx; cx < sat->chunk_cols; cx++) {
+        const int* local = getSummedAreaLocal(sat, cx, cy);
+        const int* prev = getSummedAreaRowPrefix(sat, cx, cy);
+        int* next = getSummedAreaRowPrefix(sat, cx + 1, cy);
+        for (int ly = 0; ly <= b; ly++) {
+            next[ly] = prev[ly] + local[ly * (b + 1) + b];
+        }
+    }
+}
+
+// recomputes the column prefixes of chunk column cx, starting at chunk row from_cy
+void buildSummedAreaColPrefix(SummedAreaTable* sat, int cx, int from_cy) {
+    const int b = sat->chunk_size;
+
+    if (from_cy == 0) {
+        for (int lx = 0; lx <= b; lx++) getSummedAreaColPrefix(sat, cx, 0)[lx] = 0;
+    }
+    for (int cy = from_cy; cy < sat->chunk_rows; cy++) {
+        const int* local = getSummedAreaLocal(sat, cx, cy);
+        const int* prev = getSummedAreaColPrefix(sat, cx, cy);
+        int* next = getSummedAreaColPrefix(sat, cx, cy + 1);
+        for (int lx = 0; lx <= b; lx++) {
+            next[lx] = prev[lx] + local[b * (b + 1) + lx];
+        }
+    }
+}
+
+// recomputes the chunk corner table from the chunk totals, starting at the corner
+// from_cx/from_cy, the corners above and left of it don't depend on the chunks after it
+void buildSummedAreaChunkPrefix(SummedAreaTable* sat, int from_cx, int from_cy) {
+    const int b = sat->chunk_size;
+    const int prefix_cols = sat->chunk_cols + 1;
+
+    for (int cy = from_cy; cy <= sat->chunk_rows; cy++) {
+        for (int cx = from_cx; cx <= sat->chunk_cols; cx++) {
+            int sum = 0;
+            if (cx > 0 && cy > 0) {
+                const int* local = getSummedAreaLocal(sat, cx - 1, cy - 1);
+                sum =
+                    local[b * (b + 1) + b] +
+                    sat->chunk_prefix[cy * prefix_cols + cx - 1] +
+                    sat->chunk_prefix[(cy - 1) * prefix_cols + cx] -
+                    sat->chunk_prefix[(cy - 1) * prefix_cols + cx - 1];
+            }
+            sat->chunk_prefix[cy * prefix_cols + cx] = sum;
+        }
+    }
+}
+
+// recomputes the tables for the rectangle of cells from x0/y0 to x1/y1 (inclusive)
+// after an edit of unknown size, only the chunks inside the rectangle, the prefixes of
+// the chunk rows and columns they are part of from there on and the corners below and
+// right of them are touched
+void refreshSummedAreaTable(SummedAreaTable* sat, int** map, int x0, int y0, int x1, int y1) {
+    const int cx0 = x0 >> sat->chunk_shift;
+    const int cy0 = y0 >> sat->chunk_shift;
+    const int cx1 = x1 >> sat->chunk_shift;
+    const int cy1 = y1 >> sat->chunk_shift;
+
+    for (int cy = cy0; cy <= cy1; cy++) {
+        for (int cx = cx0; cx <= cx1; cx++) {
+            buildSummedAreaChunk(sat, map, cx, cy);
+        }
+    }
+    for (int cy = cy0; cy <= cy1; cy++) buildSummedAreaRowPrefix(sat, cy, cx0);
+    for (int cx = cx0; cx <= cx1; cx++) buildSummedAreaColPrefix(sat, cx, cy0);
+    buildSummedAreaChunkPrefix(sat, cx0, cy0);
+}
+
+// (re)computes all tables from the map
+void buildSummedAreaTable(SummedAreaTable* sat, int** map) {
+    refreshSummedAreaTable(sat, map, 0, 0, sat->cols - 1, sat->rows - 1);
+}
+
+// chunk_size is rounded up to the next power of two
+SummedAreaTable createSummedAreaTable(int** map, int map_rows, int map_cols, int chunk_size) {
+    int chunk_shift = 0;
+    while ((1 << chunk_shift) < chunk_size) chunk_shift++;
+    chunk_size = 1 << chunk_shift;
+
+    SummedAreaTable sat = {
+        .rows = map_rows,
+        .cols = map_cols,
+        .chunk_size = chunk_size,
+        .chunk_shift = chunk_shift,
+        .chunk_rows = (map_rows + chunk_size - 1) / chunk_size,
+        .chunk_cols = (map_cols + chunk_size - 1) / chunk_size,
+    };
+    const size_t side = (size_t)chunk_size + 1;
+    const size_t chunk_count = (size_t)sat.chunk_rows * (size_t)sat.chunk_cols;
+    sat.local = heapAlloc(sizeof (int) * chunk_count * side * side);
+    sat.chunk_prefix = heapAlloc(sizeof (int) * (sat.chunk_rows + 1) * (sat.chunk_cols + 1));
+    sat.row_prefix = heapAlloc(sizeof (int) * sat.chunk_rows * (sat.chunk_cols + 1) * side);
+    sat.col_prefix = heapAlloc(sizeof (int) * sat.chunk_cols * (sat.chunk_rows + 1) * side);
+
+    buildSummedAreaTable(&sat, map);
+    return sat;
+}
+
+void destroySummedAreaTable(SummedAreaTable* sat) {
+    heapFree(sat->local);
+    heapFree(sat->chunk_prefix);
+    heapFree(sat->row_prefix);
+    heapFree(sat->col_prefix);
+    *sat = (SummedAreaTable){ 0 };
+}
+
+size_t getSummedAreaTableBytes(const SummedAreaTable* sat) {
+    const size_t side = (size_t)sat->chunk_size + 1;
+    const size_t chunk_rows = (size_t)sat->chunk_rows;
+    const size_t chunk_cols = (size_t)sat->chunk_cols;
+    return sizeof (int) * (
+        chunk_rows * chunk_cols * side * side +
+        (chunk_rows + 1) * (chunk_cols + 1) +
+        chunk_rows * (chunk_cols + 1) * side +
+        chunk_cols * (chunk_rows + 1) * side
+    );
+}
+
+// returns the number of walls in all cells above and left of the grid corner x/y
+// x and y have to be in the range [0, cols] and [0, rows] respectively
+int getSummedArea(const SummedAreaTable* sat, int x, int y) {
+    const int b = sat->chunk_size;
+    const int cx = x >> sat->chunk_shift;
+    const int cy = y >> sat->chunk_shift;
+    const int lx = x & (b - 1);
+    const int ly = y & (b - 1);
+
+    int sum = sat->chunk_prefix[cy * (sat->chunk_cols + 1) + cx];
+    if (ly > 0) sum += getSummedAreaRowPrefix(sat, cx, cy)[ly];
+    if (lx > 0) sum += getSummedAreaColPrefix(sat, cx, cy)[lx];
+    if (lx > 0 && ly > 0) sum += getSummedAreaLocal(sat, cx, cy)[ly * (b + 1) + lx];
+    return sum;
+}
+
+// returns the number of walls in the rectangle of cells from x0/y0 to x1/y1 (inclusive)
+// the parts of the rectangle outside of the map don't contain walls
+int countWallsInRect(const SummedAreaTable* sat, int x0, int y0, int x1, int y1) {
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > sat->cols - 1) x1 = sat->cols - 1;
+    if (y1 > sat->rows - 1) y1 = sat->rows - 1;
+    if (x0 > x1 || y0 > y1) return 0;
+
+    return
+        getSummedArea(sat, x1 + 1, y1 + 1) -
+        getSummedArea(sat, x0, y1 + 1) -
+        getSummedArea(sat, x1 + 1, y0) +
+        getSummedArea(sat, x0, y0);
+}
+
+// returns the number of walls in the rectangle of chunks from chunk_x0/chunk_y0 to
+// chunk_x1/chunk_y1 (inclusive), which only reads the chunk corner table
+int countWallsInChunkRect(const SummedAreaTable* sat, int chunk_x0, int chunk_y0, int chunk_x1, int chunk_y1) {
+    if (chunk_x0 < 0) chunk_x0 = 0;
+    if (chunk_y0 < 0) chunk_y0 = 0;
+    if (chunk_x1 > sat->chunk_cols - 1) chunk_x1 = sat->chunk_cols - 1;
+    if (chunk_y1 > sat->chunk_rows - 1) chunk_y1 = sat->chunk_rows - 1;
+    if (chunk_x0 > chunk_x1 || chunk_y0 > chunk_y1) return 0;
+
+    const int prefix_cols = sat->chunk_cols + 1;
+    return
+        sat->chunk_prefix[(chunk_y1 + 1) * prefix_cols + chunk_x1 + 1] -
+        sat->chunk_prefix[(chunk_y1 + 1) * prefix_cols + chunk_x0] -
+        sat->chunk_prefix[chunk_y0 * prefix_cols + chunk_x1 + 1] +
+        sat->chunk_prefix[chunk_y0 * prefix_cols + chunk_x0];
+}
+
+// checks if there are no walls in the rectangle of cells from x0/y0 to x1/y1 (inclusive)
+// e.g. to check if something of a given size can be placed or spawned there
+bool isRectEmpty(const SummedAreaTable* sat, int x0, int y0, int x1, int y1) {
+    return countWallsInRect(sat, x0, y0, x1, y1) == 0;
+}
+
+// returns the largest radius r up to max_radius for which the square of cells from
+// x - r/y - r to x + r/y + r contains no walls, only powers of two are tried
+// the search starts at hint_radius and doubles or halves from there
+// returns 0 if not even the 3x3 square around the cell is empty
+int findEmptySquareRadius(const SummedAreaTable* sat, int x, int y, int hint_radius, int max_radius) {
+    int r = (hint_radius < 1) ? 1 : (hint_radius > max_radius) ? max_radius : hint_radius;
+
+    if (isRectEmpty(sat, x - r, y - r, x + r, y + r)) {
+        while (r * 2 <= max_radius && isRectEmpty(sat, x - 2 * r, y - 2 * r, x + 2 * r, y + 2 * r)) {
+            r *= 2;
+        }
+        return r;
+    }
+
+    while (r > 1) {
+        r /= 2;
+        if (isRectEmpty(sat, x - r, y - r, x + r, y + r)) return r;
+    }
+    return 0;
+}
+
+// same as castRayDDAHit, but whenever the ray is in open space it jumps straight across
+// an empty square around its cell instead of visiting every cell in it
+// NOTE: testing a square is a lot more expensive than stepping through a single cell,
+//       so this only pays off on maps with large open areas
+RayHit castRayDDASkip
+(
+    Vector2 start_pos,
+    Vector2 direction,
+    int** map,
+    int map_rows,
+    int map_cols,
+    float tile_size,
+    float max_distance,
+    const SummedAreaTable* sat,
+    // the layers that stop the ray, the table counts cells of every layer, so squares
+    // with cells of other layers in them are never skipped
+    int layer_mask
+) {
+    // the largest square that is tried, in cells from the center to the border
+    const int max_radius = 256;
+    // jumping across fewer cells than this costs more than stepping through them
+    const int min_radius = 2;
+    // after a failed attempt to jump, the ray is probably close to a wall, so a few
+    // cells are stepped through normally before the next attempt
+    // every further failure in a row doubles the number of cells up to this limit
+    const int max_retry_steps = 16;
+
+    // the setup is the same as in castRayDDAHit
+    const Vector2 step_dir = {
+        .x = sqrtf(1.0f + (direction.y / direction.x) * (direction.y / direction.x)),
+        .y = sqrtf(1.0f + (direction.x / direction.y) * (direction.x / direction.y)),
+    };
+    const int step_x = (direction.x < 0.0f) ? -1 : 1;
+    const int step_y = (direction.y < 0.0f) ? -1 : 1;
+
+    int cur_map_x = (int)(start_pos.x / tile_size);
+    int cur_map_y = (int)(start_pos.y / tile_size);
+
+    Vector2 ray_len;
+    if (step_x == -1) {
+        ray_len.x = (start_pos.x - (float)cur_map_x * tile_size) * step_dir.x;
+    } else {
+        ray_len.x = ((float)(cur_map_x + 1) * tile_size - start_pos.x) * step_dir.x;
+    }
+    if (step_y == -1) {
+        ray_len.y = (start_pos.y - (float)cur_map_y * tile_size) * step_dir.y;
+    } else {
+        ray_len.y = ((float)(cur_map_y + 1) * tile_size - start_pos.y) * step_dir.y;
+    }
+
+    bool has_hit_wall = false;
+    int side = 0;
+    float distance = 0.0f;
+    int steps_until_jump = 0;
+    int retry_steps = 1;
+    // the size of the square that is tried next
+    // only one square is tested per iteration: it grows after every successful jump and
+    // shrinks after every failed one, which follows the amount of open space around the
+    // ray with a single query most of the time
+    int try_radius = min_radius;
+
+    while (!has_hit_wall && distance < max_distance) {
+        // the rectangle of cells (inclusive) that is known to be empty around the ray
+        bool can_jump = false;
+        int box_x0 = 0;
+        int box_y0 = 0;
+        int box_x1 = 0;
+        int box_y1 = 0;
+
+        if (steps_until_jump == 0) {
+            const bool is_inside_map =
+                cur_map_x >= 0 && cur_map_x < map_cols &&
+                cur_map_y >= 0 && cur_map_y < map_rows;
+
+            bool is_empty;
+            if (try_radius >= sat->chunk_size && is_inside_map) {
+                // squares of at least one chunk are tested as whole chunks around the
+                // current one, which only needs the small chunk corner table
+                const int k = try_radius >> sat->chunk_shift;
+                const int chunk_x = cur_map_x >> sat->chunk_shift;
+                const int chunk_y = cur_map_y >> sat->chunk_shift;
+                is_empty = countWallsInChunkRect(
+                    sat,
+                    chunk_x - k,
+                    chunk_y - k,
+                    chunk_x + k,
+                    chunk_y + k
+                ) == 0;
+                box_x0 = (chunk_x - k) * sat->chunk_size;
+                box_y0 = (chunk_y - k) * sat->chunk_size;
+                box_x1 = (chunk_x + k + 1) * sat->chunk_size - 1;
+                box_y1 = (chunk_y + k + 1) * sat->chunk_size - 1;
+            } else {
+                box_x0 = cur_map_x - try_radius;
+                box_y0 = cur_map_y - try_radius;
+                box_x1 = cur_map_x + try_radius;
+                box_y1 = cur_map_y + try_radius;
+                is_empty = isRectEmpty(sat, box_x0, box_y0, box_x1, box_y1);
+            }
+
+            if (is_empty) {
+                can_jump = true;
+                if (try_radius * 2 <= max_radius) try_radius *= 2;
+                retry_steps = 1;
+            } else if (try_radius > min_radius) {
+                // try a smaller square from the same cell
+                try_radius /= 2;
+                continue;
+            } else {
+                steps_until_jump = retry_steps;
+                retry_steps = (retry_steps * 2 > max_retry_steps) ? max_retry_steps : retry_steps * 2;
+            }
+        } else {
+            steps_until_jump--;
+        }
+
+        if (can_jump) {
+            // the ray is somewhere inside the box, it leaves it through the far vertical
+            // or horizontal side, whichever it reaches first
+            // the distances to these sides follow from the distances to the current
+            // cell's sides, as all grid lines are tile_size apart
+            const int far_x = (step_x == 1) ? box_x1 : box_x0;
+            const int far_y = (step_y == 1) ? box_y1 : box_y0;
+            const float exit_x = ray_len.x + (float)abs(far_x - cur_map_x) * tile_size * step_dir.x;
+            const float exit_y = ray_len.y + (float)abs(far_y - cur_map_y) * tile_size * step_dir.y;
+
+            if (exit_x < exit_y) {
+                distance = exit_x;
+                side = 0;
+                cur_map_x = far_x + step_x;
+                ray_len.x = exit_x + step_dir.x * tile_size;
+
+                // find the cell the ray is in along the other axis and the distance to
+                // its next horizontal grid line
+                // the cell has to be inside the box, which also guards against
+                // rounding errors right at a grid line
+                const float pos_y = start_pos.y + direction.y * distance;
+                cur_map_y = (int)floorf(pos_y / tile_size);
+                if (cur_map_y < box_y0) cur_map_y = box_y0;
+                if (cur_map_y > box_y1) cur_map_y = box_y1;
+                if (step_y == -1) {
+                    ray_len.y = (start_pos.y - (float)cur_map_y * tile_size) * step_dir.y;
+                } else {
+                    ray_len.y = ((float)(cur_map_y + 1) * tile_size - start_pos.y) * step_dir.y;
+                }
+            } else {
+                distance = exit_y;
+                side = 1;
+                cur_map_y = far_y + step_y;
+                ray_len.y = exit_y + step_dir.y * tile_size;
+
+                const float pos_x = start_pos.x + direction.x * distance;
+                cur_map_x = (int)floorf(pos_x / tile_size);
+                if (cur_map_x < box_x0) cur_map_x = box_x0;
+                if (cur_map_x > box_x1) cur_map_x = box_x1;
+                if (step_x == -1) {
+                    ray_len.x = (start_pos.x - (float)cur_map_x * tile_size) * step_dir.x;
+                } else {
+                    ray_len.x = ((float)(cur_map_x + 1) * tile_size - start_pos.x) * step_dir.x;
+                }
+            }
+        } else {
+            if (ray_len.x < ray_len.y) {
+                cur_map_x += step_x;
+                side = 0;
+                distance = ray_len.x;
+                ray_len.x += step_dir.x * tile_size;
+            } else {
+                cur_map_y += step_y;
+                side = 1;
+                distance = ray_len.y;
+                ray_len.y += step_dir.y * tile_size;
+            }
+        }
+
+        if
+        (
+            distance < max_distance &&
+            cur_map_x >= 0 && cur_map_x < map_cols &&
+            cur_map_y >= 0 && cur_map_y < map_rows
+        ) {
+            float hit_distance;
+            has_hit_wall = isCellHit(
+                map[cur_map_y][cur_map_x],
+                layer_mask,
+                start_pos,
+                direction,
+                cur_map_x,
+                cur_map_y,
+                tile_size,
+                distance,
+                fminf(ray_len.x, ray_len.y),
+                &hit_distance
+            );
+            if (has_hit_wall && hit_distance > distance) {
+                distance = hit_distance;
+                side = SIDE_SLOPE;
+            }
+        }
+    }
+
+    return (RayHit){
+        .distance = (has_hit_wall) ? distance : max_distance,
+        .cell_x = cur_map_x,
+        .cell_y = cur_map_y,
+        .side = side,
+        .has_hit_wall = has_hit_wall,
+    };
+}
+
+// the states a node of a region quadtree can be in
+enum {
+    QUAD_EMPTY,
+    QUAD_SOLID,
+    // the node has four children with different states
+    QUAD_MIXED,
+};
+
+typedef struct QuadNode {
+    // index of the first of the four children (top left, top right, bottom left,
+    // bottom right), which are always stored next to each other, -1 for leaves
+    int first_child;
+    int state;
+} QuadNode;
+
+// a region quadtree of the map, whose leaves are squares of cells that are either all
+// open or all walls
+// large open areas and large solid blobs become a handful of leaves, which a ray can
+// cross in one step each instead of visiting every cell
+typedef struct QuadTree {
+    // the side length of the root square in cells, a power of two that covers the map
+    // the cells outside of the map are open
+    int size;
+    int map_rows;
+    int map_cols;
+    QuadNode* nodes;
+    int node_count;
+    int node_capacity;
+    // the first of a chain of unused groups of four nodes, -1 if there is none
+    // the groups are linked through the first_child of their first node
+    int free_children;
+} QuadTree;
+
+// returns the index of four new nodes that are leaves with the given state
+int allocQuadChildren(QuadTree* qt, int state) {
+    int index = qt->free_children;
+    if (index >= 0) {
+        qt->free_children = qt->nodes[index].first_child;
+    } else {
+        if (qt->node_count + 4 > qt->node_capacity) {
+            qt->node_capacity = (qt->node_capacity > 0) ? qt->node_capacity * 2 : 64;
+            qt->nodes = heapRealloc(qt->nodes, sizeof (QuadNode) * qt->node_capacity);
+        }
+        index = qt->node_count;
+        qt->node_count += 4;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        qt->nodes[index + i] = (QuadNode){ .first_child = -1, .state = state };
+    }
+    return index;
+}
+
+void freeQuadChildren(QuadTree* qt, int index) {
+    qt->nodes[index].first_child = qt->free_children;
+    qt->free_children = index;
+}
+
+// if the four children of node are leaves with the same state, node becomes a leaf
+// with that state, returns true if the children were merged
+bool mergeQuadChildren(QuadTree* qt, int node) {
+    const int first = qt->nodes[node].first_child;
+    const int state = qt->nodes[first].state;
+    if (state == QUAD_MIXED) return false;
+    for (int i = 1; i < 4; i++) {
+        if (qt->nodes[first + i].state != state) return false;
+    }
+
+    freeQuadChildren(qt, first);
+    qt->nodes[node] = (QuadNode){ .first_child = -1, .state = state };
+    return true;
+}
+
+void buildQuadNode(QuadTree* qt, int node, int x, int y, int size, int** map) {
+    if (size == 1) {
+        const bool is_wall = x < qt->map_cols && y < qt->map_rows && map[y][x] != 0;
+        qt->nodes[node] = (QuadNode){ .first_child = -1, .state = is_wall ? QUAD_SOLID : QUAD_EMPTY };
+        return;
+    }
+    if (x >= qt->map_cols || y >= qt->map_rows) {
+        qt->nodes[node] = (QuadNode){ .first_child = -1, .state = QUAD_EMPTY };
+        return;
+    }
+
+    const int first = allocQuadChildren(qt, QUAD_EMPTY);
+    qt->nodes[node] = (QuadNode){ .first_child = first, .state = QUAD_MIXED };
+
+    const int half = size / 2;
+    for (int i = 0; i < 4; i++) {
+        buildQuadNode(qt, first + i, x + (i & 1) * half, y + (i >> 1) * half, half, map);
+    }
+    mergeQuadChildren(qt, node);
+}
+
+QuadTree createQuadTree(int** map, int map_rows, int map_cols) {
+    QuadTree qt = {
+        .size = 1,
+        .map_rows = map_rows,
+        .map_cols = map_cols,
+        .nodes = heapAlloc(sizeof (QuadNode) * 64),
+        .node_count = 1,
+        .node_capacity = 64,
+        .free_children = -1,
+    };
+    while (qt.size < map_rows || qt.size < map_cols) qt.size *= 2;
+
+    buildQuadNode(&qt, 0, 0, 0, qt.size, map);
+    return qt;
+}
+
+void destroyQuadTree(QuadTree* qt) {
+    heapFree(qt->nodes);
+    *qt = (QuadTree){ 0 };
+}
+
+// returns the number of bytes the nodes of the quadtree take up, including unused ones
+size_t getQuadTreeBytes(const QuadTree* qt) {
+    return sizeof (QuadNode) * (size_t)qt->node_capacity;
+}
+
+// marks the cell at x/y as wall or open
+// leaves are split on the way down and merged again on the way up, so the tree stays
+// as small as possible
+void setQuadTreeCell(QuadTree* qt, int x, int y, bool is_wall) {
+    const int state = is_wall ? QUAD_SOLID : QUAD_EMPTY;
+
+    // the nodes from the root down to the cell, a tree over a map of up to 2^31 cells
+    // per side can't be deeper than this
+    int path[32];
+    int depth = 0;
+
+    int node = 0;
+    int node_x = 0;
+    int node_y = 0;
+    int size = qt->size;
+    while (true) {
+        if (qt->nodes[node].state == state) return;
+        if (size == 1) {
+            qt->nodes[node].state = state;
+            break;
+        }
+        if (qt->nodes[node].first_child < 0) {
+            // a leaf that is about to get one cell that differs from the rest
+            const int first = allocQuadChildren(qt, qt->nodes[node].state);
+            qt->nodes[node] = (QuadNode){ .first_child = first, .state = QUAD_MIXED };
+        }
+
+        path[depth++] = node;
+        size /= 2;
+        const int quadrant = (x >= node_x + size) + 2 * (y >= node_y + size);
+        node_x += (quadrant & 1) * size;
+        node_y += (quadrant >> 1) * size;
+        node = qt->nodes[node].first_child + quadrant;
+    }
+
+    while (depth > 0 && mergeQuadChildren(qt, path[--depth])) {}
+}
+
+// finds the leaf that contains the cell at x/y, which has to be inside the root square
+// returns the leaf's state and stores its square in the box parameters (in cells)
+int findQuadLeaf(const QuadTree* qt, int x, int y, int* box_x, int* box_y, int* box_size) {
+    int node = 0;
+    int node_x = 0;
+    int node_y = 0;
+    int size = qt->size;
+    while (qt->nodes[node].first_child >= 0) {
+        size /= 2;
+        const int quadrant = (x >= node_x + size) + 2 * (y >= node_y + size);
+        node_x += (quadrant & 1) * size;
+        node_y += (quadrant >> 1) * size;
+        node = qt->nodes[node].first_child + quadrant;
+    }
+
+    *box_x = node_x;
+    *box_y = node_y;
+    *box_size = size;
+    return qt->nodes[node].state;
+}
+
+// same as castRayDDAHit, but steps from leaf to leaf of the quadtree instead of from
+// cell to cell
+RayHit castRayQuadTree
+(
+    Vector2 start_pos,
+    Vector2 direction,
+    const QuadTree* qt,
+    float tile_size,
+    float max_distance
+) {
+    const int step_x = (direction.x < 0.0f) ? -1 : 1;
+    const int step_y = (direction.y < 0.0f) ? -1 : 1;
+    const Vector2 inv_dir = { 1.0f / direction.x, 1.0f / direction.y };
+
+    const RayHit miss = {
+        .distance = max_distance,
+        .cell_x = -1,
+        .cell_y = -1,
+        .side = 0,
+        .has_hit_wall = false,
+    };
+
+    // the square that is crossed next, in cells
+    // the ray starts out in the single cell it starts in, which is never checked for
+    // walls, just like in castRayDDAHit
+    int box_x = (int)floorf(start_pos.x / tile_size);
+    int box_y = (int)floorf(start_pos.y / tile_size);
+    int box_size = 1;
+    float distance = 0.0f;
+
+    const float root_len = (float)qt->size * tile_size;
+    const bool starts_outside =
+        start_pos.x < 0.0f || start_pos.x >= root_len ||
+        start_pos.y < 0.0f || start_pos.y >= root_len;
+    if (starts_outside) {
+        // everything outside of the root square is open, so the ray can skip straight
+        // to where it enters the root square, and the root square itself acts as the
+        // box the ray is crossing before that
+        const float tx0 = (0.0f - start_pos.x) * inv_dir.x;
+        const float tx1 = (root_len - start_pos.x) * inv_dir.x;
+        const float ty0 = (0.0f - start_pos.y) * inv_dir.y;
+        const float ty1 = (root_len - start_pos.y) * inv_dir.y;
+        const float t_enter = fmaxf(fminf(tx0, tx1), fminf(ty0, ty1));
+        const float t_exit = fminf(fmaxf(tx0, tx1), fmaxf(ty0, ty1));
+        if (t_enter > t_exit || t_exit < 0.0f || t_enter >= max_distance) return miss;
+
+        const bool enters_x = fminf(tx0, tx1) > fminf(ty0, ty1);
+        const Vector2 enter_pos = Vector2Add(start_pos, Vector2Scale(direction, t_enter));
+        int cell_x = (int)floorf(enter_pos.x / tile_size);
+        int cell_y = (int)floorf(enter_pos.y / tile_size);
+        if (enters_x) cell_x = (step_x == 1) ? 0 : qt->size - 1;
+        else cell_y = (step_y == 1) ? 0 : qt->size - 1;
+        if (cell_x < 0) cell_x = 0;
+        if (cell_x > qt->size - 1) cell_x = qt->size - 1;
+        if (cell_y < 0) cell_y = 0;
+        if (cell_y > qt->size - 1) cell_y = qt->size - 1;
+
+        const int state = findQuadLeaf(qt, cell_x, cell_y, &box_x, &box_y, &box_size);
+        if (state == QUAD_SOLID) {
+            return (RayHit){
+                .distance = t_enter,
+                .cell_x = cell_x,
+                .cell_y = cell_y,
+                .side = enters_x ? 0 : 1,
+                .has_hit_wall = true,
+            };
+        }
+        distance = t_enter;
+    }
+
+    while (distance < max_distance) {
+        // the distances to the far vertical and horizontal side of the box
+        const int far_x = (step_x == 1) ? box_x + box_size : box_x;
+        const int far_y = (step_y == 1) ? box_y + box_size : box_y;
+        const float t_x = (direction.x != 0.0f)
+            ? ((float)far_x * tile_size - start_pos.x) * inv_dir.x
+            : INFINITY;
+        const float t_y = (direction.y != 0.0f)
+            ? ((float)far_y * tile_size - start_pos.y) * inv_dir.y
+            : INFINITY;
+
+        // find the cell right behind the side the ray leaves the box through
+        // the cell along the other axis has to be in the box, which also guards against
+        // rounding errors right at a grid line
+        int cell_x;
+        int cell_y;
+        int side;
+        if (t_x < t_y) {
+            distance = t_x;
+            side = 0;
+            cell_x = (step_x == 1) ? far_x : far_x - 1;
+            cell_y = (int)floorf((start_pos.y + direction.y * distance) / tile_size);
+            if (cell_y < box_y) cell_y = box_y;
+            if (cell_y > box_y + box_size - 1) cell_y = box_y + box_size - 1;
+        } else {
+            distance = t_y;
+            side = 1;
+            cell_y = (step_y == 1) ? far_y : far_y - 1;
+            cell_x = (int)floorf((start_pos.x + direction.x * distance) / tile_size);
+            if (cell_x < box_x) cell_x = box_x;
+            if (cell_x > box_x + box_size - 1) cell_x = box_x + box_size - 1;
+        }
+
+        // once the ray has left the root square, it can't come back
+        if (cell_x < 0 || cell_x >= qt->size || cell_y < 0 || cell_y >= qt->size) break;
+        if (distance >= max_distance) break;
+
+        if (findQuadLeaf(qt, cell_x, cell_y, &box_x, &box_y, &box_size) == QUAD_SOLID) {
+            return (RayHit){
+                .distance = distance,
+                .cell_x = cell_x,
+                .cell_y = cell_y,
+                .side = side,
+                .has_hit_wall = true,
+            };
+        }
+    }
+
+    return miss;
+}
+
+// a map of pointy top hexagons, addressed with axial coordinates q/r
+// every row r is shifted by half a hexagon against the row above, rows are stored with
+// column q + r / 2, so the map covers a rectangle on screen instead of a parallelogram
+// one bit per hexagon, packed into 64 bit words row by row
+typedef struct HexMap {
+    int rows;
+    int cols;
+    int words_per_row;
+    uint64_t* bits;
+} HexMap;
+
+// the axial steps to the six neighbours of a hexagon, neighbour i lies in the
+// direction of -60 * i degrees (the y-axis points down on screen)
+const int hex_neighbour_q[6] = { 1, 1, 0, -1, -1, 0 };
+const int hex_neighbour_r[6] = { 0, -1, -1, 0, 1, 1 };
+
+HexMap createHexMap(int rows, int cols) {
+    HexMap hex = {
+        .rows = rows,
+        .cols = cols,
+        .words_per_row = (cols + 63) / 64,
+    };
+    hex.bits = heapCalloc((size_t)rows * (size_t)hex.words_per_row, sizeof (uint64_t));
+    return hex;
+}
+
+void destroyHexMap(HexMap* hex) {
+    heapFree(hex->bits);
+    *hex = (HexMap){ 0 };
+}
+
+// hexagons outside of the map are never walls
+bool isHexWall(const HexMap* hex, int q, int r) {
+    const int col = q + (r >> 1);
+    if (r < 0 || r >= hex->rows || col < 0 || col >= hex->cols) return false;
+    return (hex->bits[r * hex->words_per_row + (col >> 6)] >> (col & 63)) & 1;
+}
+
+void setHexWall(HexMap* hex, int q, int r, bool is_wall) {
+    const int col = q + (r >> 1);
+    if (r < 0 || r >= hex->rows || col < 0 || col >= hex->cols) return;
+
+    uint64_t* word = &hex->bits[r * hex->words_per_row + (col >> 6)];
+    if (is_wall) {
+        *word |= (uint64_t)1 << (col & 63);
+    } else {
+        *word &= ~((uint64_t)1 << (col & 63));
+    }
+}
+
+// the center of a hexagon in pixel space, hex_size is the distance from the center to
+// a corner
+Vector2 hexToPixel(int q, int r, float hex_size) {
+    return (Vector2){
+        .x = hex_size * sqrtf(3.0f) * ((float)q + 0.5f * (float)r),
+        .y = hex_size * 1.5f * (float)r,
+    };
+}
+
+// finds the hexagon a point in pixel space lies in
+void pixelToHex(Vector2 pos, float hex_size, int* q, int* r) {
+    const float fq = (sqrtf(3.0f) / 3.0f * pos.x - pos.y / 3.0f) / hex_size;
+    const float fr = (2.0f / 3.0f * pos.y) / hex_size;
+    const float fs = -fq - fr;
+
+    // round in cube coordinates and fix the component that was rounded the most
+    float rq = roundf(fq);
+    float rr = roundf(fr);
+    const float rs = roundf(fs);
+    const float dq = fabsf(rq - fq);
+    const float dr = fabsf(rr - fr);
+    const float ds = fabsf(rs - fs);
+    if (dq > dr && dq > ds) {
+        rq = -rr - rs;
+    } else if (dr > ds) {
+        rr = -rq - rs;
+    }
+
+    *q = (int)rq;
+    *r = (int)rr;
+}
+
+// returns where a ray hits a wall on a hex map, with the same semantics as castRayDDAHit
+// (the start hexagon isn't checked, hexagons outside of the map aren't walls)
+// cell_x/cell_y of the hit are q/r, side is the index of the neighbour direction the
+// ray has stepped in last, see hex_neighbour_q
+// every hexagon edge lies on a line whose normal is one of the six neighbour directions
+// of the three normals that point along the ray, the ray leaves the current hexagon
+// through the edge it reaches first
+// the distance to each of these edges changes by a constant amount whenever the ray
+// steps into a neighbour, so like on a square grid, the loop only compares and adds
+RayHit castRayHex
+(
+    Vector2 start_pos,
+    // normalized unit vector
+    Vector2 direction,
+    const HexMap* hex,
+    float hex_size,
+    float max_distance
+) {
+    int q, r;
+    pixelToHex(start_pos, hex_size, &q, &r);
+    const Vector2 center = hexToPixel(q, r, hex_size);
+    const Vector2 offset = Vector2Subtract(start_pos, center);
+
+    // the distance from the center of a hexagon to its edges
+    const float apothem = hex_size * sqrtf(3.0f) * 0.5f;
+
+    // for each of the three pairs of opposite edges, the neighbour that lies along the
+    // ray, the distance at which the ray reaches that edge of the current hexagon and
+    // how much that distance grows when the ray steps into each of the neighbours
+    int axis_neighbour[3];
+    float axis_len[3];
+    float axis_step[3][3];
+    float axis_dot[3];
+    Vector2 axis_normal[3];
+    for (int k = 0; k < 3; k++) {
+        const float angle = -(float)k * PI / 3.0f;
+        Vector2 normal = { cosf(angle), sinf(angle) };
+        float dot = Vector2DotProduct(normal, direction);
+        axis_neighbour[k] = k;
+        if (dot < 0.0f) {
+            normal = Vector2Negate(normal);
+            dot = -dot;
+            axis_neighbour[k] = k + 3;
+        }
+        axis_normal[k] = normal;
+        axis_dot[k] = dot;
+        axis_len[k] = (dot > 0.0f) ? (apothem - Vector2DotProduct(normal, offset)) / dot : INFINITY;
+    }
+    for (int k = 0; k < 3; k++) {
+        for (int j = 0; j < 3; j++) {
+            // stepping along normal j moves the center by 2 * apothem * normal j, which
+            // brings the next edge along normal k that much closer in its direction
+            axis_step[k][j] = (axis_dot[k] > 0.0f)
+                ? 2.0f * apothem * Vector2DotProduct(axis_normal[k], axis_normal[j]) / axis_dot[k]
+                : 0.0f;
+        }
+    }
+
+    int side = 0;
+    float distance = 0.0f;
+    bool has_hit_wall = false;
+    while (!has_hit_wall && distance < max_distance) {
+        int axis = 0;
+        if (axis_len[1] < axis_len[axis]) axis = 1;
+        if (axis_len[2] < axis_len[axis]) axis = 2;
+
+        distance = axis_len[axis];
+        side = axis_neighbour[axis];
+        q += hex_neighbour_q[side];
+        r += hex_neighbour_r[side];
+        axis_len[0] += axis_step[0][axis];
+        axis_len[1] += axis_step[1][axis];
+        axis_len[2] += axis_step[2][axis];
+
+        has_hit_wall = isHexWall(hex, q, r);
+    }
+
+    return (RayHit){
+        .distance = (has_hit_wall) ? distance : max_distance,
+        .cell_x = q,
+        .cell_y = r,
+        .side = side,
+        .has_hit_wall = has_hit_wall,
+    };
+}
+
+// casts a batch of rays on a hex map, see castRayBatch
+void castRayHexBatch
+(
+    const Vector2* origins,
+    // normalized unit vectors
+    const Vector2* directions,
+    int count,
+    const HexMap* hex,
+    float hex_size,
+    float max_distance,
+    float* distances
+) {
+    for (int i = 0; i < count; i++) {
+        distances[i] = castRayHex(origins[i], directions[i], hex, hex_size, max_distance).distance;
+    }
+}
+
+// thin walls that lie on the grid lines between cells instead of filling whole cells
+// cell x/y owns its north edge (the grid line at the top of the cell) and its west edge
+// (the grid line at the left), the south and east edges are the north/west edges of the
+// neighbours, so every grid line segment is stored exactly once
+// the edges are kept in two bitsets of (rows + 1) * (cols + 1) bits, one row of 64 bit
+// words per row of cells, the extra row and column hold the south and east border
+typedef struct EdgeMap {
+    int rows;
+    int cols;
+    int words_per_row;
+    uint64_t* north;
+    uint64_t* west;
+} EdgeMap;
+
+EdgeMap createEdgeMap(int rows, int cols) {
+    EdgeMap edges = {
+        .rows = rows,
+        .cols = cols,
+        .words_per_row = (cols + 1 + 63) / 64,
+    };
+    const size_t word_count = (size_t)(rows + 1) * (size_t)edges.words_per_row;
+    edges.north = heapCalloc(word_count, sizeof (uint64_t));
+    edges.west = heapCalloc(word_count, sizeof (uint64_t));
+    return edges;
+}
+
+void destroyEdgeMap(EdgeMap* edges) {
+    heapFree(edges->north);
+    heapFree(edges->west);
+    *edges = (EdgeMap){ 0 };
+}
+
+// edges outside of the map are never solid
+bool getEdgeBit(const EdgeMap* edges, const uint64_t* bits, int x, int y) {
+    if (x < 0 || x > edges->cols || y < 0 || y > edges->rows) return false;
+    return (bits[y * edges->words_per_row + (x >> 6)] >> (x & 63)) & 1;
+}
+
+void setEdgeBit(EdgeMap* edges, uint64_t* bits, int x, int y, bool is_solid) {
+    if (x < 0 || x > edges->cols || y < 0 || y > edges->rows) return;
+
+    uint64_t* word = &bits[y * edges->words_per_row + (x >> 6)];
+    if (is_solid) {
+        *word |= (uint64_t)1 << (x & 63);
+    } else {
+        *word &= ~((uint64_t)1 << (x & 63));
+    }
+}
+
+bool isNorthEdgeSolid(const EdgeMap* edges, int x, int y) {
+    return getEdgeBit(edges, edges->north, x, y);
+}
+
+bool isWestEdgeSolid(const EdgeMap* edges, int x, int y) {
+    return getEdgeBit(edges, edges->west, x, y);
+}
+
+void setNorthEdge(EdgeMap* edges, int x, int y, bool is_solid) {
+    setEdgeBit(edges, edges->north, x, y, is_solid);
+}
+
+void setWestEdge(EdgeMap* edges, int x, int y, bool is_solid) {
+    setEdgeBit(edges, edges->west, x, y, is_solid);
+}
+
+// opens or closes a door, which is nothing more than a single edge
+// returns the new state so a key can simply toggle it
+bool toggleNorthEdge(EdgeMap* edges, int x, int y) {
+    const bool is_solid = !isNorthEdgeSolid(edges, x, y);
+    setNorthEdge(edges, x, y, is_solid);
+    return is_solid;
+}
+
+bool toggleWestEdge(EdgeMap* edges, int x, int y) {
+    const bool is_solid = !isWestEdgeSolid(edges, x, y);
+    setWestEdge(edges, x, y, is_solid);
+    return is_solid;
+}
+
+// same as castRayDDAHit, but on an edge map: instead of looking at the cell that was
+// entered, each step looks at the grid line segment that was crossed
+// cell_x/cell_y of the hit are the cell on the near side of the wall, side tells if the
+// wall was a vertical (0) or a horizontal (1) grid line, like in castRayDDAHit
+RayHit castRayEdges
+(
+    Vector2 start_pos,
+    // normalized unit vector
+    Vector2 direction,
+    const EdgeMap* edges,
+    float tile_size,
+    float max_distance
+) {
+    const float delta_x = (direction.x != 0.0f) ? tile_size / fabsf(direction.x) : INFINITY;
+    const float delta_y = (direction.y != 0.0f) ? tile_size / fabsf(direction.y) : INFINITY;
+
+    int cur_map_x = (int)floorf(start_pos.x / tile_size);
+    int cur_map_y = (int)floorf(start_pos.y / tile_size);
+    const int step_x = (direction.x < 0.0f) ? -1 : 1;
+    const int step_y = (direction.y < 0.0f) ? -1 : 1;
+
+    // the west edge that is crossed when stepping in x is the one of the cell itself when
+    // moving left and the one of the next cell when moving right, same for north edges
+    const int edge_offset_x = (step_x > 0) ? 1 : 0;
+    const int edge_offset_y = (step_y > 0) ? 1 : 0;
+
+    float ray_len_x = (direction.x != 0.0f)
+        ? ((float)(cur_map_x + edge_offset_x) * tile_size - start_pos.x) / direction.x
+        : INFINITY;
+    float ray_len_y = (direction.y != 0.0f)
+        ? ((float)(cur_map_y + edge_offset_y) * tile_size - start_pos.y) / direction.y
+        : INFINITY;
+
+    bool has_hit_wall = false;
+    int side = 0;
+    float distance = 0.0f;
+    while (distance < max_distance) {
+        if (ray_len_x < ray_len_y) {
+            distance = ray_len_x;
+            side = 0;
+            if (isWestEdgeSolid(edges, cur_map_x + edge_offset_x, cur_map_y)) {
+                has_hit_wall = true;
+                break;
+            }
+            cur_map_x += step_x;
+            ray_len_x += delta_x;
+        } else {
+            distance = ray_len_y;
+            side = 1;
+            if (isNorthEdgeSolid(edges, cur_map_x, cur_map_y + edge_offset_y)) {
+                has_hit_wall = true;
+                break;
+            }
+            cur_map_y += step_y;
+            ray_len_y += delta_y;
+        }
+    }
+
+    return (RayHit){
+        .distance = (has_hit_wall) ? distance : max_distance,
+        .cell_x = cur_map_x,
+        .cell_y = cur_map_y,
+        .side = side,
+        .has_hit_wall = has_hit_wall,
+    };
+}
+
+// the four faces of a cell, with their outward normals
+enum {
+    FACE_WEST,
+    FACE_EAST,
+    FACE_NORTH,
+    FACE_SOUTH,
+};
+
+const int face_normal_x[4] = { -1, 1, 0, 0 };
+const int face_normal_y[4] = { 0, 0, -1, 1 };
+
+// a cell face that leads somewhere else, on another map or on the same one
+// a ray that leaves the source cell through the source face enters the target cell
+// through the target face, rotated so it moves away from that face into the target cell
+// and at the same spot along the face
+typedef struct Portal {
+    int map_index;
+    int cell_x;
+    int cell_y;
+    int face;
+    int target_map;
+    int target_x;
+    int target_y;
+    int target_face;
+} Portal;
+
+// one map of a portal world, the map itself belongs to the caller
+typedef struct PortalMap {
+    int** map;
+    int rows;
+    int cols;
+    // one bit per face of every cell that has a portal on it, see the FACE values
+    uint8_t* portal_faces;
+} PortalMap;
+
+// a set of maps linked by portals, so a large building can be split into many small maps
+// that each fit into the cache, instead of one huge sparse grid
+typedef struct PortalWorld {
+    PortalMap* maps;
+    int map_count;
+    // sorted by source map, row, column and face, so they can be found by binary search
+    Portal* portals;
+    int portal_count;
+    int portal_capacity;
+} PortalWorld;
+
+PortalWorld createPortalWorld(int map_count) {
+    return (PortalWorld){
+        .maps = heapCalloc(map_count, sizeof (PortalMap)),
+        .map_count = map_count,
+    };
+}
+
+void destroyPortalWorld(PortalWorld* world) {
+    for (int i = 0; i < world->map_count; i++) heapFree(world->maps[i].portal_faces);
+    heapFree(world->maps);
+    heapFree(world->portals);
+    *world = (PortalWorld){ 0 };
+}
+
+void setPortalWorldMap(PortalWorld* world, int map_index, int** map, int map_rows, int map_cols) {
+    PortalMap* pm = &world->maps[map_index];
+    heapFree(pm->portal_faces);
+    *pm = (PortalMap){
+        .map = map,
+        .rows = map_rows,
+        .cols = map_cols,
+        .portal_faces = heapCalloc((size_t)map_rows * (size_t)map_cols, sizeof (uint8_t)),
+    };
+}
+
+int comparePortalSource(const Portal* a, int map_index, int cell_x, int cell_y, int face) {
+    if (a->map_index != map_index) return (a->map_index < map_index) ? -1 : 1;
+    if (a->cell_y != cell_y) return (a->cell_y < cell_y) ? -1 : 1;
+    if (a->cell_x != cell_x) return (a->cell_x < cell_x) ? -1 : 1;
+    if (a->face != face) return (a->face < face) ? -1 : 1;
+    return 0;
+}
+
+// returns the index of the first portal that isn't ordered before the given face
+int lowerBoundPortal(const PortalWorld* world, int map_index, int cell_x, int cell_y, int face) {
+    int low = 0;
+    int high = world->portal_count;
+    while (low < high) {
+        const int mid = (low + high) / 2;
+        if (comparePortalSource(&world->portals[mid], map_index, cell_x, cell_y, face) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+const Portal* findPortal(const PortalWorld* world, int map_index, int cell_x, int cell_y, int face) {
+    const int i = lowerBoundPortal(world, map_index, cell_x, cell_y, face);
+    if (i == world->portal_count) return NULL;
+    if (comparePortalSource(&world->portals[i], map_index, cell_x, cell_y, face) != 0) return NULL;
+    return &world->portals[i];
+}
+
+// adds a one way portal, or replaces the one that is already on the source face
+// the source cell has to be inside its map
+void addPortal(PortalWorld* world, Portal portal) {
+    const int i = lowerBoundPortal(world, portal.map_index, portal.cell_x, portal.cell_y, portal.face);
+    const bool is_new =
+        i == world->portal_count ||
+        comparePortalSource(&world->portals[i], portal.map_index, portal.cell_x, portal.cell_y, portal.face) != 0;
+
+    if (is_new) {
+        if (world->portal_count == world->portal_capacity) {
+            world->portal_capacity = (world->portal_capacity > 0) ? world->portal_capacity * 2 : 64;
+            world->portals = heapRealloc(world->portals, sizeof (Portal) * world->portal_capacity);
+        }
+        memmove(&world->portals[i + 1], &world->portals[i], sizeof (Portal) * (world->portal_count - i));
+        world->portal_count++;
+    }
+    world->portals[i] = portal;
+
+    PortalMap* pm = &world->maps[portal.map_index];
+    pm->portal_faces[portal.cell_y * pm->cols + portal.cell_x] |= (uint8_t)(1 << portal.face);
+}
+
+// links two faces both ways, a ray leaving through one enters through the other
+void linkPortals
+(
+    PortalWorld* world,
+    int map_a,
+    int x_a,
+    int y_a,
+    int face_a,
+    int map_b,
+    int x_b,
+    int y_b,
+    int face_b
+) {
+    addPortal(world, (Portal){ map_a, x_a, y_a, face_a, map_b, x_b, y_b, face_b });
+    addPortal(world, (Portal){ map_b, x_b, y_b, face_b, map_a, x_a, y_a, face_a });
+}
+
+// where a ray cast by castRayPortals has stopped
+typedef struct PortalHit {
+    // distance is the total length of the ray over all maps, cell_x/cell_y are on the map
+    // the ray has stopped in
+    RayHit hit;
+    int map_index;
+    // the point the ray has stopped at, in the space of that map
+    Vector2 end_pos;
+    int hop_count;
+    // denotes that the ray was stopped by a portal because it already went through
+    // max_hops portals, hit.has_hit_wall is set in that case as well
+    bool is_hop_limited;
+} PortalHit;
+
+// checks if the ray hits the cell it is inside from entry to exit (see castRayDDAHit)
+bool hitsPortalMapCell
+(
+    const PortalMap* pm,
+    int cell_x,
+    int cell_y,
+    int layer_mask,
+    Vector2 start_pos,
+    Vector2 direction,
+    float tile_size,
+    float entry,
+    float exit,
+    float* hit_distance
+) {
+    if (cell_x < 0 || cell_x >= pm->cols || cell_y < 0 || cell_y >= pm->rows) return false;
+    return isCellHit(
+        pm->map[cell_y][cell_x],
+        layer_mask,
+        start_pos,
+        direction,
+        cell_x,
+        cell_y,
+        tile_size,
+        entry,
+        exit,
+        hit_distance
+    );
+}
+
+// same as castRayDDAHit, but the ray goes on through the portals it runs into, with
+// whatever is left of max_distance, until it has gone through max_hops portals
+// all maps share the same tile_size
+PortalHit castRayPortals
+(
+    const PortalWorld* world,
+    // the map the ray starts in
+    int map_index,
+    Vector2 start_pos,
+    // normalized unit vector
+    Vector2 direction,
+    float tile_size,
+    float max_distance,
+    int max_hops,
+    // the layers that stop the ray, see LAYER_VISION
+    int layer_mask
+) {
+    PortalHit result = { .map_index = map_index };
+
+    Vector2 pos = start_pos;
+    Vector2 dir = direction;
+    int cur_map_x = (int)floorf(pos.x / tile_size);
+    int cur_map_y = (int)floorf(pos.y / tile_size);
+    // the distance traveled on the maps before the current one
+    float traveled = 0.0f;
+    int side = 0;
+
+    while (true) {
+        const PortalMap* pm = &world->maps[result.map_index];
+
+        const int step_x = (dir.x < 0.0f) ? -1 : 1;
+        const int step_y = (dir.y < 0.0f) ? -1 : 1;
+        const float delta_x = (dir.x != 0.0f) ? tile_size / fabsf(dir.x) : INFINITY;
+        const float delta_y = (dir.y != 0.0f) ? tile_size / fabsf(dir.y) : INFINITY;
+        float ray_len_x = (dir.x != 0.0f)
+            ? ((float)(cur_map_x + (step_x > 0)) * tile_size - pos.x) / dir.x
+            : INFINITY;
+        float ray_len_y = (dir.y != 0.0f)
+            ? ((float)(cur_map_y + (step_y > 0)) * tile_size - pos.y) / dir.y
+            : INFINITY;
+
+        // a ray that has just come out of a portal has to check the cell it came out into
+        float distance = 0.0f;
+        float hit_distance;
+        if
+        (
+            result.hop_count > 0 &&
+            hitsPortalMapCell(
+                pm,
+                cur_map_x,
+                cur_map_y,
+                layer_mask,
+                pos,
+                dir,
+                tile_size,
+                0.0f,
+                fminf(ray_len_x, ray_len_y),
+                &hit_distance
+            )
+        ) {
+            result.hit = (RayHit){
+                .distance = traveled + hit_distance,
+                .cell_x = cur_map_x,
+                .cell_y = cur_map_y,
+                .side = (hit_distance > 0.0f) ? SIDE_SLOPE : side,
+                .has_hit_wall = true,
+            };
+            result.end_pos = Vector2Add(pos, Vector2Scale(dir, hit_distance));
+            return result;
+        }
+
+        const Portal* portal = NULL;
+        while (traveled + distance < max_distance) {
+            const bool is_x_step = ray_len_x < ray_len_y;
+            const int face = is_x_step
+                ? ((step_x > 0) ? FACE_EAST : FACE_WEST)
+                : ((step_y > 0) ? FACE_SOUTH : FACE_NORTH);
+            const float crossing = is_x_step ? ray_len_x : ray_len_y;
+
+            // the face the ray is about to leave through may be a portal
+            if
+            (
+                cur_map_x >= 0 && cur_map_x < pm->cols &&
+                cur_map_y >= 0 && cur_map_y < pm->rows &&
+                (pm->portal_faces[cur_map_y * pm->cols + cur_map_x] >> face) & 1
+            ) {
+                if (traveled + crossing >= max_distance) break;
+                if (result.hop_count == max_hops) {
+                    result.hit = (RayHit){
+                        .distance = traveled + crossing,
+                        .cell_x = cur_map_x,
+                        .cell_y = cur_map_y,
+                        .side = is_x_step ? 0 : 1,
+                        .has_hit_wall = true,
+                    };
+                    result.end_pos = Vector2Add(pos, Vector2Scale(dir, crossing));
+                    result.is_hop_limited = true;
+                    return result;
+                }
+                portal = findPortal(world, result.map_index, cur_map_x, cur_map_y, face);
+                distance = crossing;
+                break;
+            }
+
+            distance = crossing;
+            if (is_x_step) {
+                cur_map_x += step_x;
+                ray_len_x += delta_x;
+                side = 0;
+            } else {
+                cur_map_y += step_y;
+                ray_len_y += delta_y;
+                side = 1;
+            }
+
+            // NOTE: open cells are turned away here, so the common case doesn't pay for
+            //       the call
+            if
+            (
+                cur_map_x >= 0 && cur_map_x < pm->cols &&
+                cur_map_y >= 0 && cur_map_y < pm->rows &&
+                (pm->map[cur_map_y][cur_map_x] & layer_mask) != 0 &&
+                hitsPortalMapCell(
+                    pm,
+                    cur_map_x,
+                    cur_map_y,
+                    layer_mask,
+                    pos,
+                    dir,
+                    tile_size,
+                    distance,
+                    fminf(ray_len_x, ray_len_y),
+                    &hit_distance
+                )
+            ) {
+                result.hit = (RayHit){
+                    .distance = traveled + hit_distance,
+                    .cell_x = cur_map_x,
+                    .cell_y = cur_map_y,
+                    .side = (hit_distance > distance) ? SIDE_SLOPE : side,
+                    .has_hit_wall = true,
+                };
+                result.end_pos = Vector2Add(pos, Vector2Scale(dir, hit_distance));
+                return result;
+            }
+        }
+
+        if (portal == NULL) {
+            result.hit = (RayHit){
+                .distance = max_distance,
+                .cell_x = cur_map_x,
+                .cell_y = cur_map_y,
+                .side = side,
+                .has_hit_wall = false,
+            };
+            result.end_pos = Vector2Add(pos, Vector2Scale(dir, max_distance - traveled));
+            return result;
+        }
+
+        // rotate the outward normal of the source face onto the inward normal of the
+        // target face, the point on the face moves along with it
+        const Vector2 normal = { (float)face_normal_x[portal->face], (float)face_normal_y[portal->face] };
+        const Vector2 inward = { -(float)face_normal_x[portal->target_face], -(float)face_normal_y[portal->target_face] };
+        const float cos_angle = normal.x * inward.x + normal.y * inward.y;
+        const float sin_angle = normal.x * inward.y - normal.y * inward.x;
+
+        const Vector2 face_center = {
+            ((float)portal->cell_x + 0.5f + 0.5f * normal.x) * tile_size,
+            ((float)portal->cell_y + 0.5f + 0.5f * normal.y) * tile_size,
+        };
+        const Vector2 target_center = {
+            ((float)portal->target_x + 0.5f - 0.5f * inward.x) * tile_size,
+            ((float)portal->target_y + 0.5f - 0.5f * inward.y) * tile_size,
+        };
+        const Vector2 offset = Vector2Subtract(Vector2Add(pos, Vector2Scale(dir, distance)), face_center);
+
+        pos = (Vector2){
+            target_center.x + cos_angle * offset.x - sin_angle * offset.y,
+            target_center.y + sin_angle * offset.x + cos_angle * offset.y,
+        };
+        dir = (Vector2){
+            cos_angle * dir.x - sin_angle * dir.y,
+            sin_angle * dir.x + cos_angle * dir.y,
+        };
+        traveled += distance;
+        side = (portal->target_face <= FACE_EAST) ? 0 : 1;
+        cur_map_x = portal->target_x;
+        cur_map_y = portal->target_y;
+        result.map_index = portal->target_map;
+        result.hop_count++;
+    }
+}
+
+// a stack of floors that all share the same grid, for buildings with several storeys
+// floor f spans the heights from f * floor_height to (f + 1) * floor_height, the floors
+// are separated by thin slabs that can be opened cell by cell for shafts and stairwells
+// every floor is two bit planes, one bit per cell, rows padded to whole words: the walls
+// of the floor and the openings of the slab above it, the opening below a cell is the
+// opening above the same cell one floor down
+// NOTE: there are no LAYER_ masks here, a wall blocks everything on its floor
+typedef struct LayeredMap {
+    int floors;
+    int rows;
+    int cols;
+    int words_per_row;
+    uint64_t* solid;
+    uint64_t* open_above;
+} LayeredMap;
+
+LayeredMap createLayeredMap(int floors, int rows, int cols) {
+    LayeredMap layers = {
+        .floors = floors,
+        .rows = rows,
+        .cols = cols,
+        .words_per_row = (cols + 63) / 64,
+    };
+    const size_t word_count = (size_t)floors * (size_t)rows * (size_t)layers.words_per_row;
+    layers.solid = heapCalloc(word_count, sizeof (uint64_t));
+    layers.open_above = heapCalloc(word_count, sizeof (uint64_t));
+    return layers;
+}
+
+void destroyLayeredMap(LayeredMap* layers) {
+    heapFree(layers->solid);
+    heapFree(layers->open_above);
+    *layers = (LayeredMap){ 0 };
+}
+
+size_t getLayeredMapBytes(const LayeredMap* layers) {
+    return 2 * sizeof (uint64_t) * (size_t)layers->floors * (size_t)layers->rows * (size_t)layers->words_per_row;
+}
+
+// returns the index of the word that holds the cell x/y of floor in either plane
+static inline size_t getLayerWord(const LayeredMap* layers, int floor, int x, int y) {
+    return ((size_t)floor * layers->rows + y) * layers->words_per_row + (x >> 6);
+}
+
+// cells outside of the grid are open, like in castRayDDAHit
+bool isLayerWall(const LayeredMap* layers, int floor, int x, int y) {
+    if (x < 0 || x >= layers->cols || y < 0 || y >= layers->rows) return false;
+    return (layers->solid[getLayerWord(layers, floor, x, y)] >> (x & 63)) & 1;
+}
+
+// returns true if the slab between floor and floor + 1 is open at the cell x/y
+// outside of the grid there are no openings
+bool isLayerSlabOpen(const LayeredMap* layers, int floor, int x, int y) {
+    if (x < 0 || x >= layers->cols || y < 0 || y >= layers->rows) return false;
+    return (layers->open_above[getLayerWord(layers, floor, x, y)] >> (x & 63)) & 1;
+}
+
+void setLayerWall(LayeredMap* layers, int floor, int x, int y, bool is_wall) {
+    uint64_t* word = &layers->solid[getLayerWord(layers, floor, x, y)];
+    const uint64_t bit = (uint64_t)1 << (x & 63);
+    *word = is_wall ? (*word | bit) : (*word & ~bit);
+}
+
+// opens or closes the slab between floor and floor + 1 at the cell x/y
+void setLayerOpening(LayeredMap* layers, int floor, int x, int y, bool is_open) {
+    uint64_t* word = &layers->open_above[getLayerWord(layers, floor, x, y)];
+    const uint64_t bit = (uint64_t)1 << (x & 63);
+    *word = is_open ? (*word | bit) : (*word & ~bit);
+}
+
+// returns true if nothing blocks the straight line between two points in the building
+// x/y are in the space of the grid, z is the height above the bottom of the lowest floor
+// walls fill their cell for the full height of their floor, a slab can only be passed
+// where it is open (outside of the grid, where there are no openings, it is always
+// closed) and nothing can be seen below the lowest or above the highest floor
+// the line is walked through the cells of all floors in one go, like castRayDDAHit in 3D
+// NOTE: like castRayDDAHit, the cell from lies in isn't checked
+bool hasLayeredLineOfSight
+(
+    const LayeredMap* layers,
+    Vector3 from,
+    Vector3 to,
+    float tile_size,
+    float floor_height
+) {
+    int cur_x = (int)floorf(from.x / tile_size);
+    int cur_y = (int)floorf(from.y / tile_size);
+    int cur_floor = (int)floorf(from.z / floor_height);
+    if (cur_floor < 0 || cur_floor >= layers->floors) return false;
+
+    // everything is measured as a fraction of the line, the line ends at 1
+    const Vector3 delta = Vector3Subtract(to, from);
+    const int step_x = (delta.x < 0.0f) ? -1 : 1;
+    const int step_y = (delta.y < 0.0f) ? -1 : 1;
+    const int step_floor = (delta.z < 0.0f) ? -1 : 1;
+    const float t_delta_x = (delta.x != 0.0f) ? tile_size / fabsf(delta.x) : INFINITY;
+    const float t_delta_y = (delta.y != 0.0f) ? tile_size / fabsf(delta.y) : INFINITY;
+    const float t_delta_z = (delta.z != 0.0f) ? floor_height / fabsf(delta.z) : INFINITY;
+    float t_x = (delta.x != 0.0f)
+        ? ((float)(cur_x + (step_x > 0)) * tile_size - from.x) / delta.x
+        : INFINITY;
+    float t_y = (delta.y != 0.0f)
+        ? ((float)(cur_y + (step_y > 0)) * tile_size - from.y) / delta.y
+        : INFINITY;
+    float t_z = (delta.z != 0.0f)
+        ? ((float)(cur_floor + (step_floor > 0)) * floor_height - from.z) / delta.z
+        : INFINITY;
+
+    while (true) {
+        if (t_x <= t_y && t_x <= t_z) {
+            if (t_x > 1.0f) return true;
+            cur_x += step_x;
+            t_x += t_delta_x;
+        } else if (t_y <= t_z) {
+            if (t_y > 1.0f) return true;
+            cur_y += step_y;
+            t_y += t_delta_y;
+        } else {
+            if (t_z > 1.0f) return true;
+
+            // the slab above the current cell, or the one above the cell of the floor below
+            const int slab_floor = (step_floor > 0) ? cur_floor : cur_floor - 1;
+            if (slab_floor < 0 || !isLayerSlabOpen(layers, slab_floor, cur_x, cur_y)) return false;
+
+            cur_floor += step_floor;
+            if (cur_floor < 0 || cur_floor >= layers->floors) return false;
+            t_z += t_delta_z;
+        }
+
+        if (isLayerWall(layers, cur_floor, cur_x, cur_y)) return false;
+    }
+}
+
+// a rectangle of wall cells, in cells
+typedef struct TileRect {
+    int x;
+    int y;
+    int width;
+    int height;
+} TileRect;
+
+// the walls of the map merged into as few rectangles as possible, so they can be drawn
+// with a handful of quads instead of one rectangle per cell
+// only full cells that block vision are merged, the others (slopes and windows) are
+// collected per chunk as well and drawn by drawShapedCells
+// the map is split into chunks that are only merged again after they were edited
+typedef struct TileMesh {
+    int map_rows;
+    int map_cols;
+    // the side length of one chunk in cells
+    int chunk_size;
+    // the number of chunks in each direction
+    int chunk_rows;
+    int chunk_cols;
+    // room for chunk_size * chunk_size rectangles per chunk, which is the most a chunk
+    // can ever need
+    TileRect* rects;
+    int* rect_counts;
+    // the shaped cells of each chunk as 1 x 1 rectangles, from the back of its rectangles
+    // NOTE: every rectangle covers at least one opaque cell and shaped cells are never
+    //       opaque, so both together always fit into the room of one chunk
+    int* shaped_counts;
+    // chunks that were edited since they were last merged
+    bool* is_dirty;
+    bool has_dirty_chunks;
+} TileMesh;
+
+TileMesh createTileMesh(int map_rows, int map_cols, int chunk_size) {
+    TileMesh mesh = {
+        .map_rows = map_rows,
+        .map_cols = map_cols,
+        .chunk_size = chunk_size,
+        .chunk_rows = (map_rows + chunk_size - 1) / chunk_size,
+        .chunk_cols = (map_cols + chunk_size - 1) / chunk_size,
+    };
+    const int chunk_count = mesh.chunk_rows * mesh.chunk_cols;
+    mesh.rects = heapAlloc(sizeof (TileRect) * chunk_count * chunk_size * chunk_size);
+    mesh.rect_counts = heapCalloc(chunk_count, sizeof (int));
+    mesh.shaped_counts = heapCalloc(chunk_count, sizeof (int));
+    mesh.is_dirty = heapAlloc(sizeof (bool) * chunk_count);
+    for (int i = 0; i < chunk_count; i++) mesh.is_dirty[i] = true;
+    mesh.has_dirty_chunks = true;
+    return mesh;
+}
+
+void destroyTileMesh(TileMesh* mesh) {
+    heapFree(mesh->rects);
+    heapFree(mesh->rect_counts);
+    heapFree(mesh->shaped_counts);
+    heapFree(mesh->is_dirty);
+    *mesh = (TileMesh){ 0 };
+}
+
+size_t getTileMeshBytes(const TileMesh* mesh) {
+    const size_t chunk_count = (size_t)mesh->chunk_rows * (size_t)mesh->chunk_cols;
+    const size_t chunk_cells = (size_t)mesh->chunk_size * (size_t)mesh->chunk_size;
+    return chunk_count * (sizeof (TileRect) * chunk_cells + 2 * sizeof (int) + sizeof (bool));
+}
+
+// marks the chunk that contains the cell at x/y to be merged again
+void markTileMeshDirty(TileMesh* mesh, int x, int y) {
+    mesh->is_dirty[(y / mesh->chunk_size) * mesh->chunk_cols + x / mesh->chunk_size] = true;
+    mesh->has_dirty_chunks = true;
+}
+
+void markTileMeshAllDirty(TileMesh* mesh) {
+    for (int i = 0; i < mesh->chunk_rows * mesh->chunk_cols; i++) mesh->is_dirty[i] = true;
+    mesh->has_dirty_chunks = true;
+}
+
+// a full cell that can't be seen through
+bool isOpaqueBlock(int cell) {
+    return (cell & LAYER_VISION) != 0 && (cell >> CELL_SHAPE_SHIFT) == SHAPE_FULL;
+}
+
+// greedily merges the walls of one chunk into rectangles: every wall cell that isn't
+// covered yet starts a rectangle, which is made as wide as possible first and then as
+// tall as possible, the shaped cells are collected on the way
+void mergeTileMeshChunk(TileMesh* mesh, int** map, int chunk_x, int chunk_y) {
+    const int b = mesh->chunk_size;
+    const int x0 = chunk_x * b;
+    const int y0 = chunk_y * b;
+    const int x1 = (x0 + b < mesh->map_cols) ? x0 + b : mesh->map_cols;
+    const int y1 = (y0 + b < mesh->map_rows) ? y0 + b : mesh->map_rows;
+
+    const int chunk = chunk_y * mesh->chunk_cols + chunk_x;
+    TileRect* rects = &mesh->rects[chunk * b * b];
+    int count = 0;
+    int shaped_count = 0;
+
+    // cells that are already part of a rectangle, in chunk space
+    // NOTE: a variable length array, chunks are small enough to live on the stack
+    bool is_covered[b * b];
+    memset(is_covered, 0, sizeof is_covered);
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            if (map[y][x] != CELL_OPEN && !isOpaqueBlock(map[y][x])) {
+                rects[b * b - 1 - shaped_count++] = (TileRect){ .x = x, .y = y, .width = 1, .height = 1 };
+                continue;
+            }
+            if (!isOpaqueBlock(map[y][x]) || is_covered[(y - y0) * b + (x - x0)]) continue;
+
+            int width = 1;
+            while
+            (
+                x + width < x1 &&
+                isOpaqueBlock(map[y][x + width]) &&
+                !is_covered[(y - y0) * b + (x + width - x0)]
+            ) {
+                width++;
+            }
+
+            int height = 1;
+            while (y + height < y1) {
+                bool is_row_solid = true;
+                for (int i = x; i < x + width; i++) {
+                    if (!isOpaqueBlock(map[y + height][i]) || is_covered[(y + height - y0) * b + (i - x0)]) {
+                        is_row_solid = false;
+                        break;
+                    }
+                }
+                if (!is_row_solid) break;
+                height++;
+            }
+
+            for (int j = y; j < y + height; j++) {
+                for (int i = x; i < x + width; i++) {
+                    is_covered[(j - y0) * b + (i - x0)] = true;
+                }
+            }
+            rects[count++] = (TileRect){ .x = x, .y = y, .width = width, .height = height };
+        }
+    }
+
+    mesh->rect_counts[chunk] = count;
+    mesh->shaped_counts[chunk] = shaped_count;
+    mesh->is_dirty[chunk] = false;
+}
+
+// merges all chunks that were edited since the last update
+void updateTileMesh(TileMesh* mesh, int** map) {
+    if (!mesh->has_dirty_chunks) return;
+
+    for (int cy = 0; cy < mesh->chunk_rows; cy++) {
+        for (int cx = 0; cx < mesh->chunk_cols; cx++) {
+            if (mesh->is_dirty[cy * mesh->chunk_cols + cx]) mergeTileMeshChunk(mesh, map, cx, cy);
+        }
+    }
+    mesh->has_dirty_chunks = false;
+}
+
+// returns the total number of rectangles, which is the number of quads drawTileMesh draws
+int getTileMeshRectCount(const TileMesh* mesh) {
+    int count = 0;
+    for (int i = 0; i < mesh->chunk_rows * mesh->chunk_cols; i++) count += mesh->rect_counts[i];
+    return count;
+}
+
+typedef struct MapEditor MapEditor;
+
+// called once per flush with the rectangles that may have changed since the last flush
+// is_bulk is set when so much of the map changed that rebuilding from scratch is cheaper
+// than updating cell by cell
+typedef void (*MapEditListener)(void* user, const MapEditor* editor, const MapRect* rects, int rect_count, bool is_bulk);
+
+#define MAX_DIRTY_RECTS 32
+#define MAX_EDIT_LISTENERS 16
+
+// the single place the map is written through
+// edits are collected as dirty rectangles during a frame and handed to every registered
+// structure that is derived from the map in one flush, so a clear or a long brush stroke
+// turns into a few rectangles instead of thousands of single cell updates
+struct MapEditor {
+    int** map;
+    int map_rows;
+    int map_cols;
+    // the journal of the current frame
+    MapRect dirty_rects[MAX_DIRTY_RECTS];
+    int dirty_count;
+    // the number of cells that actually changed value since the last flush
+    int changed_count;
+    // a flush is a bulk update once the dirty rectangles cover at least this many cells
+    int bulk_cells;
+    MapEditListener listeners[MAX_EDIT_LISTENERS];
+    void* listener_users[MAX_EDIT_LISTENERS];
+    int listener_count;
+};
+
+MapEditor createMapEditor(int** map, int map_rows, int map_cols) {
+    return (MapEditor){
+        .map = map,
+        .map_rows = map_rows,
+        .map_cols = map_cols,
+        // NOTE: a rough cut-off, the incremental distance field and quadtree updates
+        //       walk every dirty cell, so once a good part of the map is dirty a
+        //       rebuild is about as cheap and always exact
+        .bulk_cells = map_rows * map_cols / 4,
+    };
+}
+
+// the journal and the listeners live inside the editor, so this is all it ever takes up
+size_t getMapEditorBytes(const MapEditor* editor) {
+    (void)editor;
+    return sizeof (MapEditor);
+}
+
+// registers a structure to be told about edits, returns false when there's no room left
+bool addMapEditListener(MapEditor* editor, MapEditListener listener, void* user) {
+    if (editor->listener_count >= MAX_EDIT_LISTENERS) return false;
+    editor->listeners[editor->listener_count] = listener;
+    editor->listener_users[editor->listener_count] = user;
+    editor->listener_count++;
+    return true;
+}
+
+int getMapRectArea(MapRect rect) {
+    return (rect.x1 - rect.x0 + 1) * (rect.y1 - rect.y0 + 1);
+}
+
+MapRect uniteMapRects(MapRect a, MapRect b) {
+    return (MapRect){
+        .x0 = (a.x0 < b.x0) ? a.x0 : b.x0,
+        .y0 = (a.y0 < b.y0) ? a.y0 : b.y0,
+        .x1 = (a.x1 > b.x1) ? a.x1 : b.x1,
+        .y1 = (a.y1 > b.y1) ? a.y1 : b.y1,
+    };
+}
+
+// adds a rectangle to the journal of the current frame
+// a rectangle is folded into an existing one when their union doesn't cover any cell
+// that neither of them covers (which is what happens while dragging a brush along a row
+// or column), otherwise it gets its own entry, and once the journal is full it is folded
+// into the entry whose bounds grow the least
+void markMapDirty(MapEditor* editor, MapRect rect) {
+    int best = -1;
+    int best_growth = 0;
+
+    for (int i = 0; i < editor->dirty_count; i++) {
+        const MapRect old = editor->dirty_rects[i];
+        const MapRect united = uniteMapRects(old, rect);
+        if (getMapRectArea(united) <= getMapRectArea(old) + getMapRectArea(rect)) {
+            // NOTE: only exact for rectangles that don't overlap, overlapping ones are
+            // folded a little too eagerly, which at worst marks a few extra cells
+            editor->dirty_rects[i] = united;
+            return;
+        }
+        const int growth = getMapRectArea(united) - getMapRectArea(old);
+        if (best < 0 || growth < best_growth) {
+            best = i;
+            best_growth = growth;
+        }
+    }
+
+    if (editor->dirty_count < MAX_DIRTY_RECTS) {
+        editor->dirty_rects[editor->dirty_count++] = rect;
+    } else {
+        editor->dirty_rects[best] = uniteMapRects(editor->dirty_rects[best], rect);
+    }
+}
+
+// writes one cell, cells that already hold the value aren't journaled
+void editMapCell(MapEditor* editor, int x, int y, int value) {
+    if (x < 0 || x >= editor->map_cols || y < 0 || y >= editor->map_rows) return;
+    if (editor->map[y][x] == value) return;
+
+    editor->map[y][x] = value;
+    editor->changed_count++;
+    markMapDirty(editor, (MapRect){ .x0 = x, .y0 = y, .x1 = x, .y1 = y });
+}
+
+// fills the cells from x0/y0 to x1/y1 (inclusive, clipped to the map) with one value
+// and journals only the bounds of the cells that changed
+void editMapRect(MapEditor* editor, int x0, int y0, int x1, int y1, int value) {
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 >= editor->map_cols) x1 = editor->map_cols - 1;
+    if (y1 >= editor->map_rows) y1 = editor->map_rows - 1;
+
+    MapRect changed = { .x0 = x1 + 1, .y0 = y1 + 1, .x1 = x0 - 1, .y1 = y0 - 1 };
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            if (editor->map[y][x] == value) continue;
+            editor->map[y][x] = value;
+            editor->changed_count++;
+            changed = uniteMapRects(changed, (MapRect){ .x0 = x, .y0 = y, .x1 = x, .y1 = y });
+        }
+    }
+
+    if (changed.x0 <= changed.x1) markMapDirty(editor, changed);
+}
+
+// copies the cells from x0/y0 to x1/y1 (inclusive, clipped to the map) from src, a map of
+// the same size, and journals only the bounds of the cells that changed
+void editMapCells(MapEditor* editor, int x0, int y0, int x1, int y1, int** src) {
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 >= editor->map_cols) x1 = editor->map_cols - 1;
+    if (y1 >= editor->map_rows) y1 = editor->map_rows - 1;
+
+    MapRect changed = { .x0 = x1 + 1, .y0 = y1 + 1, .x1 = x0 - 1, .y1 = y0 - 1 };
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            if (editor->map[y][x] == src[y][x]) continue;
+            editor->map[y][x] = src[y][x];
+            editor->changed_count++;
+            changed = uniteMapRects(changed, (MapRect){ .x0 = x, .y0 = y, .x1 = x, .y1 = y });
+        }
+    }
+
+    if (changed.x0 <= changed.x1) markMapDirty(editor, changed);
+}
+
+// brings the map in line with next, a map of the same size, one chunk of chunk_size cells
+// square at a time: a chunk is compared row by row with memcmp and skipped if it's equal,
+// otherwise it's copied through editMapCells, so reloading a map after a small change only
+// journals the chunks that changed instead of the whole map
+// returns the number of chunks that differed
+int applyMapDiff(MapEditor* editor, int** next, int chunk_size) {
+    int changed_chunks = 0;
+
+    for (int y0 = 0; y0 < editor->map_rows; y0 += chunk_size) {
+        const int y1 = (y0 + chunk_size < editor->map_rows) ? y0 + chunk_size - 1 : editor->map_rows - 1;
+        for (int x0 = 0; x0 < editor->map_cols; x0 += chunk_size) {
+            const int x1 = (x0 + chunk_size < editor->map_cols) ? x0 + chunk_size - 1 : editor->map_cols - 1;
+            const size_t row_bytes = sizeof (int) * (size_t)(x1 - x0 + 1);
+
+            bool is_equal = true;
+            for (int y = y0; y <= y1 && is_equal; y++) {
+                is_equal = memcmp(&editor->map[y][x0], &next[y][x0], row_bytes) == 0;
+            }
+            if (is_equal) continue;
+
+            editMapCells(editor, x0, y0, x1, y1, next);
+            changed_chunks++;
+        }
+    }
+
+    return changed_chunks;
+}
+
+// hands the journal of the current frame to every listener and starts a new one
+// meant to be called once per frame, before anything reads the derived structures
+void flushMapEdits(MapEditor* editor) {
+    if (editor->dirty_count == 0) return;
+
+    int dirty_cells = 0;
+    for (int i = 0; i < editor->dirty_count; i++) dirty_cells += getMapRectArea(editor->dirty_rects[i]);
+    const bool is_bulk = dirty_cells >= editor->bulk_cells;
+
+    for (int i = 0; i < editor->listener_count; i++) {
+        editor->listeners[i](editor->listener_users[i], editor, editor->dirty_rects, editor->dirty_count, is_bulk);
+    }
+
+    editor->dirty_count = 0;
+    editor->changed_count = 0;
+}
+
+// listeners that keep the derived structures in sync with the editor
+// all of them read the new state from the map, since the old values are gone by the
+// time the journal is flushed
+
+void onMapEditOccupancy(void* user, const MapEditor* editor, const MapRect* rects, int rect_count, bool is_bulk) {
+    OccupancyBlocks* occ = user;
+    (void)is_bulk;
+
+    for (int r = 0; r < rect_count; r++) {
+        const int bx0 = rects[r].x0 / occ->block_size;
+        const int by0 = rects[r].y0 / occ->block_size;
+        const int bx1 = rects[r].x1 / occ->block_size;
+        const int by1 = rects[r].y1 / occ->block_size;
+        for (int by = by0; by <= by1; by++) {
+            for (int bx = bx0; bx <= bx1; bx++) {
+                const int y_end = ((by + 1) * occ->block_size < editor->map_rows) ? (by + 1) * occ->block_size : editor->map_rows;
+                const int x_end = ((bx + 1) * occ->block_size < editor->map_cols) ? (bx + 1) * occ->block_size : editor->map_cols;
+                int count = 0;
+                for (int y = by * occ->block_size; y < y_end; y++) {
+                    for (int x = bx * occ->block_size; x < x_end; x++) count += (editor->map[y][x] != 0);
+                }
+                occ->counts[by * occ->cols + bx] = count;
+            }
+        }
+    }
+}
+
+void onMapEditSummedArea(void* user, const MapEditor* editor, const MapRect* rects, int rect_count, bool is_bulk) {
+    SummedAreaTable* sat = user;
+
+    if (is_bulk) {
+        buildSummedAreaTable(sat, editor->map);
+        return;
+    }
+    for (int r = 0; r < rect_count; r++) {
+        refreshSummedAreaTable(sat, editor->map, rects[r].x0, rects[r].y0, rects[r].x1, rects[r].y1);
+    }
+}
+
+void onMapEditDistanceField(void* user, const MapEditor* editor, const MapRect* rects, int rect_count, bool is_bulk) {
+    DistanceField* df = user;
+
+    if (is_bulk) {
+        buildDistanceField(df, editor->map);
+        return;
+    }
+    updateDistanceFieldRects(df, editor->map, rects, rect_count);
+}
+
+void onMapEditQuadTree(void* user, const MapEditor* editor, const MapRect* rects, int rect_count, bool is_bulk) {
+    QuadTree* qt = user;
+
+    if (is_bulk) {
+        destroyQuadTree(qt);
+        *qt = createQuadTree(editor->map, editor->map_rows, editor->map_cols);
+        return;
+    }
+    for (int r = 0; r < rect_count; r++) {
+        for (int y = rects[r].y0; y <= rects[r].y1; y++) {
+            for (int x = rects[r].x0; x <= rects[r].x1; x++) setQuadTreeCell(qt, x, y, editor->map[y][x] != 0);
+        }
+    }
+}
+
+void onMapEditTileMesh(void* user, const MapEditor* editor, const MapRect* rects, int rect_count, bool is_bulk) {
+    TileMesh* mesh = user;
+    (void)editor;
+
+    if (is_bulk) {
+        markTileMeshAllDirty(mesh);
+        return;
+    }
+    for (int r = 0; r < rect_count; r++) {
+        for (int cy = rects[r].y0 / mesh->chunk_size; cy <= rects[r].y1 / mesh->chunk_size; cy++) {
+            for (int cx = rects[r].x0 / mesh->chunk_size; cx <= rects[r].x1 / mesh->chunk_size; cx++) {
+                markTileMeshDirty(mesh, cx * mesh->chunk_size, cy * mesh->chunk_size);
+            }
+        }
+    }
+}
+
+// a binary log of map edits, meant to keep copies of the map in other processes (ray
+// query servers and such) in sync at a cost that only depends on the edits
+// batches are appended and only kept until sendMapDeltas has written them out, so the log
+// stays as large as the edits between two sends
+// every flush of the editor becomes one batch:
+//   u32 sequence, u32 run_count, then run_count runs of u16 x, u16 y, u16 length, u16 value
+// a run sets length cells of row y starting at x to value, all numbers are little endian
+// NOTE: runs store the state after the edit, not the change, so replaying overlapping
+//       runs in order always ends up at the same map
+#define MAP_DELTA_BATCH_BYTES 8
+#define MAP_DELTA_RUN_BYTES 8
+
+typedef struct MapDeltaLog {
+    uint8_t* bytes;
+    size_t size;
+    size_t capacity;
+    uint32_t next_sequence;
+} MapDeltaLog;
+
+// applies batches from a MapDeltaLog to a copy of the map
+typedef struct MapDeltaReader {
+    // bytes of a batch that hasn't been received completely yet
+    uint8_t* pending;
+    size_t pending_size;
+    size_t pending_capacity;
+    uint32_t next_sequence;
+    long long applied_runs;
+} MapDeltaReader;
+
+void putU16(uint8_t* bytes, uint16_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+void putU32(uint8_t* bytes, uint32_t value) {
+    putU16(bytes, (uint16_t)value);
+    putU16(bytes + 2, (uint16_t)(value >> 16));
+}
+
+uint16_t getU16(const uint8_t* bytes) {
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+uint32_t getU32(const uint8_t* bytes) {
+    return getU16(bytes) | ((uint32_t)getU16(bytes + 2) << 16);
+}
+
+// grows a byte buffer so there's room for at least extra more bytes
+void reserveBytes(uint8_t** bytes, size_t* capacity, size_t size, size_t extra) {
+    if (size + extra <= *capacity) return;
+
+    size_t new_capacity = (*capacity > 0) ? *capacity : 4096;
+    while (new_capacity < size + extra) new_capacity *= 2;
+    *bytes = heapRealloc(*bytes, new_capacity);
+    *capacity = new_capacity;
+}
+
+MapDeltaLog createMapDeltaLog(void) {
+    return (MapDeltaLog){ 0 };
+}
+
+void destroyMapDeltaLog(MapDeltaLog* log) {
+    heapFree(log->bytes);
+    *log = (MapDeltaLog){ 0 };
+}
+
+size_t getMapDeltaLogBytes(const MapDeltaLog* log) {
+    return log->capacity;
+}
+
+// appends one batch with the current state of the cells inside the rectangles
+// every row of a rectangle is cut into runs of equal cells, so a cleared map costs one
+// run per row
+void appendMapDeltas(MapDeltaLog* log, int** map, const MapRect* rects, int rect_count) {
+    reserveBytes(&log->bytes, &log->capacity, log->size, MAP_DELTA_BATCH_BYTES);
+    const size_t batch = log->size;
+    log->size += MAP_DELTA_BATCH_BYTES;
+
+    uint32_t run_count = 0;
+    for (int r = 0; r < rect_count; r++) {
+        for (int y = rects[r].y0; y <= rects[r].y1; y++) {
+            int x = rects[r].x0;
+            while (x <= rects[r].x1) {
+                const int value = map[y][x];
+                int length = 1;
+                while (x + length <= rects[r].x1 && map[y][x + length] == value && length < UINT16_MAX) {
+                    length++;
+                }
+
+                reserveBytes(&log->bytes, &log->capacity, log->size, MAP_DELTA_RUN_BYTES);
+                uint8_t* run = &log->bytes[log->size];
+                putU16(run, (uint16_t)x);
+                putU16(run + 2, (uint16_t)y);
+                putU16(run + 4, (uint16_t)length);
+                putU16(run + 6, (uint16_t)value);
+                log->size += MAP_DELTA_RUN_BYTES;
+                run_count++;
+                x += length;
+            }
+        }
+    }
+
+    putU32(&log->bytes[batch], log->next_sequence++);
+    putU32(&log->bytes[batch + 4], run_count);
+}
+
+void onMapEditDeltaLog(void* user, const MapEditor* editor, const MapRect* rects, int rect_count, bool is_bulk) {
+    (void)is_bulk;
+    appendMapDeltas(user, editor->map, rects, rect_count);
+}
+
+// writes everything that was appended since the last call to fd, the written bytes are
+// dropped from the log since the receiver has them now, the capacity is kept for the
+// next batches
+// returns false if the write failed, the unsent bytes are kept for the next try then
+bool sendMapDeltas(MapDeltaLog* log, int fd) {
+    bool is_sent = true;
+    size_t sent = 0;
+    while (sent < log->size) {
+        const ssize_t written = write(fd, &log->bytes[sent], log->size - sent);
+        if (written <= 0) {
+            is_sent = false;
+            break;
+        }
+        sent += (size_t)written;
+    }
+
+    if (sent > 0) {
+        memmove(log->bytes, &log->bytes[sent], log->size - sent);
+        log->size -= sent;
+    }
+    return is_sent;
+}
+
+MapDeltaReader createMapDeltaReader(void) {
+    return (MapDeltaReader){ 0 };
+}
+
+void destroyMapDeltaReader(MapDeltaReader* reader) {
+    heapFree(reader->pending);
+    *reader = (MapDeltaReader){ 0 };
+}
+
+// applies every complete batch in bytes (plus what was left over from the last call) to
+// map, an incomplete batch at the end is kept until the rest of it arrives
+// returns the number of batches applied, or -1 if a batch is out of sequence or reaches
+// outside the map, in which case the replica has to be loaded from scratch
+int applyMapDeltas(MapDeltaReader* reader, int** map, int map_rows, int map_cols, const uint8_t* bytes, size_t size) {
+    reserveBytes(&reader->pending, &reader->pending_capacity, reader->pending_size, size);
+    memcpy(&reader->pending[reader->pending_size], bytes, size);
+    reader->pending_size += size;
+
+    int batch_count = 0;
+    size_t offset = 0;
+    while (reader->pending_size - offset >= MAP_DELTA_BATCH_BYTES) {
+        const uint8_t* batch = &reader->pending[offset];
+        const uint32_t sequence = getU32(batch);
+        const uint32_t run_count = getU32(batch + 4);
+        const size_t batch_size = MAP_DELTA_BATCH_BYTES + (size_t)run_count * MAP_DELTA_RUN_BYTES;
+        if (reader->pending_size - offset < batch_size) break;
+        if (sequence != reader->next_sequence) return -1;
+
+        for (uint32_t i = 0; i < run_count; i++) {
+            const uint8_t* run = &batch[MAP_DELTA_BATCH_BYTES + i * MAP_DELTA_RUN_BYTES];
+            const int x = getU16(run);
+            const int y = getU16(run + 2);
+            const int length = getU16(run + 4);
+            if (y >= map_rows || x + length > map_cols) return -1;
+            const int value = getU16(run + 6);
+            for (int j = x; j < x + length; j++) map[y][j] = value;
+        }
+
+        reader->next_sequence++;
+        reader->applied_runs += run_count;
+        offset += batch_size;
+        batch_count++;
+    }
+
+    memmove(reader->pending, &reader->pending[offset], reader->pending_size - offset);
+    reader->pending_size -= offset;
+    return batch_count;
+}
+
+// reads whatever is available on fd and applies it, see applyMapDeltas
+// returns -1 on a read error as well
+int receiveMapDeltas(MapDeltaReader* reader, int fd, int** map, int map_rows, int map_cols) {
+    uint8_t buffer[4096];
+    const ssize_t received = read(fd, buffer, sizeof buffer);
+    if (received < 0) return -1;
+    return applyMapDeltas(reader, map, map_rows, map_cols, buffer, (size_t)received);
+}
+
+// chunk buffers are cache line aligned so two chunks never share a line
+#define CHUNK_ALIGNMENT 64
+#define CHUNK_MAGAZINE_SIZE 32
+
+// a slab allocator for the fixed size buffers of streamed chunks
+// blocks are cut from large slabs that are never given back until the pool is destroyed,
+// free blocks are kept in a list that is linked through the blocks themselves
+// NOTE: threads don't use the pool directly but through a ChunkMagazine of their own,
+//       which only takes the lock to move half a magazine at once
+typedef struct ChunkPool {
+    size_t block_size;
+    int blocks_per_slab;
+    LargeBlock* slabs;
+    int slab_count;
+    int slab_capacity;
+    void* free_list;
+    int free_count;
+    pthread_mutex_t lock;
+} ChunkPool;
+
+// NOTE: unlike the other create functions, the pool is set up in place, a mutex must not
+//       be copied after it was initialized
+void initChunkPool(ChunkPool* pool, size_t block_size, int blocks_per_slab) {
+    *pool = (ChunkPool){
+        .block_size = (block_size + CHUNK_ALIGNMENT - 1) & ~(size_t)(CHUNK_ALIGNMENT - 1),
+        .blocks_per_slab = blocks_per_slab,
+    };
+    // a free block has to hold the pointer to the next one
+    if (pool->block_size < sizeof (void*)) pool->block_size = CHUNK_ALIGNMENT;
+    pthread_mutex_init(&pool->lock, NULL);
+}
+
+void destroyChunkPool(ChunkPool* pool) {
+    for (int i = 0; i < pool->slab_count; i++) freeLargeBlock(&pool->slabs[i]);
+    heapFree(pool->slabs);
+    pthread_mutex_destroy(&pool->lock);
+    *pool = (ChunkPool){ 0 };
+}
+
+size_t getChunkPoolBytes(const ChunkPool* pool) {
+    return pool->block_size * (size_t)pool->blocks_per_slab * (size_t)pool->slab_count;
+}
+
+// adds one slab worth of blocks to the free list, must be called with the lock held
+bool addChunkSlab(ChunkPool* pool) {
+    // slabs come from mmap, so they are page aligned and so are all blocks
+    LargeBlock slab = allocLargeBlock(pool->block_size * (size_t)pool->blocks_per_slab, false);
+    if (slab.bytes == NULL) return false;
+
+    if (pool->slab_count == pool->slab_capacity) {
+        pool->slab_capacity = (pool->slab_capacity > 0) ? pool->slab_capacity * 2 : 8;
+        pool->slabs = heapRealloc(pool->slabs, sizeof (LargeBlock) * pool->slab_capacity);
+    }
+    pool->slabs[pool->slab_count++] = slab;
+
+    // linked back to front so blocks are handed out in address order
+    uint8_t* bytes = slab.bytes;
+    for (int i = pool->blocks_per_slab - 1; i >= 0; i--) {
+        void* block = &bytes[(size_t)i * pool->block_size];
+        *(void**)block = pool->free_list;
+        pool->free_list = block;
+    }
+    pool->free_count += pool->blocks_per_slab;
+    return true;
+}
+
+// moves up to count free blocks into blocks, a new slab is added if the pool ran dry
+// returns the number of blocks taken, which is only 0 if no slab could be mapped
+int takeChunkBlocks(ChunkPool* pool, void** blocks, int count) {
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_list == NULL) addChunkSlab(pool);
+
+    int taken = 0;
+    while (taken < count && pool->free_list != NULL) {
+        blocks[taken++] = pool->free_list;
+        pool->free_list = *(void**)pool->free_list;
+    }
+    pool->free_count -= taken;
+    pthread_mutex_unlock(&pool->lock);
+    return taken;
+}
+
+// gives count blocks back to the pool at once, they are linked up before taking the lock
+void returnChunkBlocks(ChunkPool* pool, void* const* blocks, int count) {
+    if (count == 0) return;
+    for (int i = 0; i < count - 1; i++) *(void**)blocks[i] = blocks[i + 1];
+
+    pthread_mutex_lock(&pool->lock);
+    *(void**)blocks[count - 1] = pool->free_list;
+    pool->free_list = blocks[0];
+    pool->free_count += count;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// the blocks one thread keeps at hand, so most allocations and frees don't touch the pool
+typedef struct ChunkMagazine {
+    ChunkPool* pool;
+    void* blocks[CHUNK_MAGAZINE_SIZE];
+    int count;
+} ChunkMagazine;
+
+ChunkMagazine createChunkMagazine(ChunkPool* pool) {
+    return (ChunkMagazine){ .pool = pool };
+}
+
+// returns one block of the pool's block size, NULL if the pool can't grow anymore
+void* allocChunk(ChunkMagazine* magazine) {
+    if (magazine->count == 0) {
+        magazine->count = takeChunkBlocks(magazine->pool, magazine->blocks, CHUNK_MAGAZINE_SIZE / 2);
+        if (magazine->count == 0) return NULL;
+    }
+    return magazine->blocks[--magazine->count];
+}
+
+void freeChunk(ChunkMagazine* magazine, void* block) {
+    // a full magazine gives its older half back, so alternating allocs and frees at the
+    // boundary don't go to the pool every time
+    if (magazine->count == CHUNK_MAGAZINE_SIZE) {
+        const int half = CHUNK_MAGAZINE_SIZE / 2;
+        returnChunkBlocks(magazine->pool, magazine->blocks, half);
+        memmove(magazine->blocks, &magazine->blocks[half], sizeof (void*) * (CHUNK_MAGAZINE_SIZE - half));
+        magazine->count -= half;
+    }
+    magazine->blocks[magazine->count++] = block;
+}
+
+// gives every block of the magazine back to the pool, e.g. before its thread exits
+void flushChunkMagazine(ChunkMagazine* magazine) {
+    returnChunkBlocks(magazine->pool, magazine->blocks, magazine->count);
+    magazine->count = 0;
+}
+
+// fills the cells of one chunk of a streamed world, chunk_size * chunk_size cells row by row
+typedef void (*ChunkLoader)(void* user, int chunk_x, int chunk_y, int chunk_size, int* cells);
+
+// the chunks of a big world around a moving point, kept in a square window of slots
+// a chunk goes into slot (chunk_x mod window, chunk_y mod window), so moving by one chunk
+// only replaces the chunks of one row or column of the window
+typedef struct ChunkStream {
+    int chunk_size;
+    // the side length of the window in chunks
+    int window;
+    // per slot, the chunk it holds and its cells, NULL if the slot is empty
+    int* slot_x;
+    int* slot_y;
+    int** slot_cells;
+    ChunkLoader loader;
+    void* user;
+    // the number of chunks loaded so far
+    long long loaded_count;
+} ChunkStream;
+
+ChunkStream createChunkStream(int chunk_size, int window, ChunkLoader loader, void* user) {
+    const int slot_count = window * window;
+    return (ChunkStream){
+        .chunk_size = chunk_size,
+        .window = window,
+        .slot_x = heapAlloc(sizeof (int) * slot_count),
+        .slot_y = heapAlloc(sizeof (int) * slot_count),
+        .slot_cells = heapCalloc(slot_count, sizeof (int*)),
+        .loader = loader,
+        .user = user,
+    };
+}
+
+// frees every resident chunk into magazine, or to the heap if magazine is NULL
+void destroyChunkStream(ChunkStream* stream, ChunkMagazine* magazine) {
+    for (int i = 0; i < stream->window * stream->window; i++) {
+        if (stream->slot_cells[i] == NULL) continue;
+        if (magazine != NULL) {
+            freeChunk(magazine, stream->slot_cells[i]);
+        } else {
+            heapFree(stream->slot_cells[i]);
+        }
+    }
+    heapFree(stream->slot_x);
+    heapFree(stream->slot_y);
+    heapFree(stream->slot_cells);
+    *stream = (ChunkStream){ 0 };
+}
+
+int getChunkSlot(const ChunkStream* stream, int chunk_x, int chunk_y) {
+    const int x = ((chunk_x % stream->window) + stream->window) % stream->window;
+    const int y = ((chunk_y % stream->window) + stream->window) % stream->window;
+    return y * stream->window + x;
+}
+
+// makes the window of chunks centered on chunk center_x/center_y resident, chunk buffers
+// come from magazine, or from the heap if magazine is NULL
+void updateChunkStream(ChunkStream* stream, ChunkMagazine* magazine, int center_x, int center_y) {
+    const int half = stream->window / 2;
+    const size_t chunk_bytes = sizeof (int) * (size_t)stream->chunk_size * (size_t)stream->chunk_size;
+
+    for (int cy = center_y - half; cy < center_y - half + stream->window; cy++) {
+        for (int cx = center_x - half; cx < center_x - half + stream->window; cx++) {
+            const int slot = getChunkSlot(stream, cx, cy);
+            int* cells = stream->slot_cells[slot];
+            if (cells != NULL && stream->slot_x[slot] == cx && stream->slot_y[slot] == cy) continue;
+
+            // the chunk that left the window makes room for the one that entered it
+            if (cells != NULL) {
+                if (magazine != NULL) {
+                    freeChunk(magazine, cells);
+                } else {
+                    heapFree(cells);
+                }
+            }
+            cells = (magazine != NULL) ? allocChunk(magazine) : heapAlloc(chunk_bytes);
+            stream->slot_cells[slot] = cells;
+            if (cells == NULL) continue;
+
+            stream->slot_x[slot] = cx;
+            stream->slot_y[slot] = cy;
+            stream->loader(stream->user, cx, cy, stream->chunk_size, cells);
+            stream->loaded_count++;
+        }
+    }
+}
+
+// returns the cell at x/y of the world, cells of chunks that aren't resident are open
+int getStreamCell(const ChunkStream* stream, int x, int y) {
+    // rounded towards negative infinity, so the chunks left of and above 0 work too
+    const int cx = (x >= 0) ? x / stream->chunk_size : -((-x - 1) / stream->chunk_size) - 1;
+    const int cy = (y >= 0) ? y / stream->chunk_size : -((-y - 1) / stream->chunk_size) - 1;
+    const int slot = getChunkSlot(stream, cx, cy);
+    const int* cells = stream->slot_cells[slot];
+    if (cells == NULL || stream->slot_x[slot] != cx || stream->slot_y[slot] != cy) return CELL_OPEN;
+    return cells[(y - cy * stream->chunk_size) * stream->chunk_size + (x - cx * stream->chunk_size)];
+}
+
+// watches a file for being saved, without blocking
+// editors often save by writing a new file and renaming it over the old one, which a watch
+// on the file itself wouldn't survive, so the directory is watched for the file's name
+// NOTE: uses inotify, so it only works on linux, elsewhere a watcher is never created
+typedef struct MapWatcher {
+    int fd;
+    char name[256];
+} MapWatcher;
+
+// fd is -1 if the file can't be watched
+MapWatcher createMapWatcher(const char* path) {
+    MapWatcher watcher = { .fd = -1 };
+#ifdef __linux__
+    const char* slash = strrchr(path, '/');
+    char dir[4096] = ".";
+    if (slash == path) {
+        snprintf(dir, sizeof dir, "/");
+    } else if (slash != NULL) {
+        snprintf(dir, sizeof dir, "%.*s", (int)(slash - path), path);
+    }
+    snprintf(watcher.name, sizeof watcher.name, "%s", (slash != NULL) ? slash + 1 : path);
+
+    watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher.fd < 0) return watcher;
+    if (inotify_add_watch(watcher.fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(watcher.fd);
+        watcher.fd = -1;
+    }
+#else
+    (void)path;
+#endif
+    return watcher;
+}
+
+void destroyMapWatcher(MapWatcher* watcher) {
+    if (watcher->fd >= 0) close(watcher->fd);
+    watcher->fd = -1;
+}
+
+// returns true if the file has been saved since the last call
+bool pollMapWatcher(MapWatcher* watcher) {
+    bool has_changed = false;
+#ifdef __linux__
+    if (watcher->fd < 0) return false;
+
+    _Alignas(struct inotify_event) char events[4096];
+    ssize_t size;
+    while ((size = read(watcher->fd, events, sizeof events)) > 0) {
+        for (ssize_t i = 0; i < size;) {
+            const struct inotify_event* event = (const struct inotify_event*)&events[i];
+            if (event->len > 0 && strcmp(event->name, watcher->name) == 0) has_changed = true;
+            i += (ssize_t)(sizeof (struct inotify_event) + event->len);
+        }
+    }
+#else
+    (void)watcher;
+#endif
+    return has_changed;
+}
+
+#define MAX_MEMORY_ENTRIES 16
+
+// what each structure takes up, filled in by whoever owns the structures so the demo and
+// the benchmarks can show the same breakdown
+typedef struct MemoryReport {
+    const char* names[MAX_MEMORY_ENTRIES];
+    size_t bytes[MAX_MEMORY_ENTRIES];
+    int count;
+    size_t total_bytes;
+} MemoryReport;
+
+void addMemoryEntry(MemoryReport* report, const char* name, size_t bytes) {
+    if (report->count == MAX_MEMORY_ENTRIES) return;
+    report->names[report->count] = name;
+    report->bytes[report->count] = bytes;
+    report->count++;
+    report->total_bytes += bytes;
+}
+
+// a pixel colour that stands for one cell value in map images
+typedef struct MapPaletteEntry {
+    Color color;
+    int cell;
+} MapPaletteEntry;
+
+// how the pixels of a map image turn into cells: a pixel with a colour of the palette
+// becomes its cell, any other opaque pixel darker than the threshold (0 to 256) becomes a
+// wall and the rest is open
+// exported images use the palette colours as well, the other walls are black and open
+// cells white
+typedef struct MapImageRule {
+    int threshold;
+    const MapPaletteEntry* palette;
+    int palette_count;
+} MapImageRule;
+
+void drawDottedLine(Vector2 start_pos, Vector2 end_pos, Color color);
+void drawQuadTree(const QuadTree* qt, float tile_size, Color color);
+void drawTileMesh(const TileMesh* mesh, float tile_size, Color color);
+void drawShapedCells(const TileMesh* mesh, int** map, float tile_size, Color color, Color window_color);
+void drawMemoryPanel(const MemoryReport* report, long long frame_allocs, int x, int y, int font_size, int margin);
+bool importMapImage(const char* path, int** map, int map_rows, int map_cols, const MapImageRule* rule);
+bool exportMapImage(const char* path, int** map, int map_rows, int map_cols, const MapImageRule* rule);
+int runBenchmarks(bool has_huge_corpus);
+int runSelfTests(void);
+
+int main(int argc, char** argv) {
+    // --bench-huge adds 16384 x 16384 maps to the corpus, which need around 8 GB of memory
+    // (the quadtree of the maze alone is over 4 GB) and take minutes
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) return runBenchmarks(false);
+    if (argc > 1 && strcmp(argv[1], "--bench-huge") == 0) return runBenchmarks(true);
+    if (argc > 1 && strcmp(argv[1], "--selftest") == 0) return runSelfTests();
+
+    // the image the map is imported from and exported to, given with --map or as a plain
+    // path, anything else starting with a dash is a mistyped option and not a file to write
+    const char* map_path = "map.png";
+    if (argc == 3 && strcmp(argv[1], "--map") == 0) {
+        map_path = argv[2];
+    } else if (argc == 2 && argv[1][0] != '-') {
+        map_path = argv[1];
+    } else if (argc > 1) {
+        fprintf(stderr, "usage: %s [--bench | --bench-huge | --selftest | [--map] path/to/map.png]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const int screen_width = 800;
+    const int screen_height = 800;
+
+    InitWindow(screen_width, screen_height, "raycasting");
+
+    const int map_rows = 80;
+    const int map_cols = 80;
+
+    int** map = createMap(map_rows, map_cols);
+
+    const float tile_size = 20.0f;
+
+    Vector2 origin_pos = { (float)screen_width / 2.0f, (float)screen_height / 2.0f };
+    Vector2 target_pos = GetMousePosition();
+
+    const float origin_spd = 8.0f;
+
+    Vector2 ray_pos = { -100.0f, -100.0f };
+    const float max_ray_len = 1000.0f;
+
+    // a fan of rays can be cast around the origin, either adaptively refined or as a
+    // uniform fan that reuses the hits of the previous frame
+    enum { FAN_OFF, FAN_ADAPTIVE, FAN_CACHED, FAN_MODE_COUNT } fan_mode = FAN_OFF;
+    const int fan_coarse_count = 32;
+    const float fan_angle_tolerance = 0.25f * DEG2RAD;
+    const int fan_dense_count = (int)ceilf(2.0f * PI / fan_angle_tolerance);
+    const int fan_max_rays = fan_dense_count + fan_coarse_count;
+    FanRay* fan_rays = NULL;
+    int fan_ray_count = 0;
+    int fan_rays_cast = 0;
+
+    const int cached_fan_count = 720;
+    RayCache fan_cache = createRayCache(cached_fan_count);
+
+    OccupancyBlocks occ = createOccupancyBlocks(map, map_rows, map_cols, 8);
+
+    // a view cone can be shown that looks from the origin towards the target
+    bool show_cone = false;
+    const float cone_half_angle = 30.0f * DEG2RAD;
+    const float cone_range = 300.0f;
+    bool cone_has_wall = false;
+    Vector2 cone_hit_pos = { 0.0f, 0.0f };
+    // the target counts as seen while it's in range and not hidden behind sight blockers
+    bool is_target_visible = true;
+
+    // the nearest wall around the origin can be shown, found with the distance field
+    DistanceField distance_field = createDistanceField(map, map_rows, map_cols);
+    bool show_nearest = false;
+    const float nearest_radius = 200.0f;
+    bool has_nearest = false;
+    Vector2 nearest_pos = { 0.0f, 0.0f };
+
+    // the leaves of the quadtree can be shown on top of the grid
+    QuadTree quad_tree = createQuadTree(map, map_rows, map_cols);
+    bool show_quad_tree = false;
+
+    // the walls are drawn as merged rectangles
+    TileMesh tile_mesh = createTileMesh(map_rows, map_cols, 16);
+
+    // what left click paints, full walls, windows or one of the slopes
+    const int brushes[] = {
+        CELL_SOLID,
+        CELL_WINDOW,
+        CELL_SLOPE_NW,
+        CELL_SLOPE_NE,
+        CELL_SLOPE_SW,
+        CELL_SLOPE_SE,
+    };
+    const int brush_count = sizeof brushes / sizeof brushes[0];
+    int brush = 0;
+
+    // every edit goes through the editor, which keeps the structures above up to date
+    MapEditor editor = createMapEditor(map, map_rows, map_cols);
+    addMapEditListener(&editor, onMapEditOccupancy, &occ);
+    addMapEditListener(&editor, onMapEditDistanceField, &distance_field);
+    addMapEditListener(&editor, onMapEditQuadTree, &quad_tree);
+    addMapEditListener(&editor, onMapEditTileMesh, &tile_mesh);
+
+    // the map can be imported from and exported to an image at map_path, dark pixels are
+    // walls and windows and slopes have colours of their own
+    const MapPaletteEntry map_palette[] = {
+        { SKYBLUE, CELL_WINDOW },
+        { RED, CELL_SLOPE_NW },
+        { GREEN, CELL_SLOPE_NE },
+        { BLUE, CELL_SLOPE_SW },
+        { YELLOW, CELL_SLOPE_SE },
+    };
+    const MapImageRule map_rule = {
+        .threshold = 128,
+        .palette = map_palette,
+        .palette_count = sizeof map_palette / sizeof map_palette[0],
+    };
+    // an import is read into here first, so only the chunks that differ go through the editor
+    int** import_map = createMap(map_rows, map_cols);
+    const int import_chunk_size = 16;
+
+    // with hot reload on, the map image is imported again whenever it's saved
+    bool is_hot_reloading = false;
+    MapWatcher map_watcher = { .fd = -1 };
+    int reloaded_chunks = 0;
+
+    // scratch data of a frame (the fan rays and such) comes from here, so once the arena
+    // has grown to fit a frame, the loop below doesn't touch the heap unless the map is edited
+    Arena frame_arena = createArena(sizeof (FanRay) * fan_max_rays);
+
+    // the memory panel lists what each structure takes up and the heap allocations of the
+    // last frame
+    bool show_memory = false;
+    long long frame_allocs = 0;
+    long long frame_alloc_start = getHeapAllocCount();
+
+    SetTargetFPS(60);
+    while (!WindowShouldClose()) {
+        frame_allocs = getHeapAllocCount() - frame_alloc_start;
+        frame_alloc_start = getHeapAllocCount();
+        resetArena(&frame_arena);
+
+        if (IsKeyDown(KEY_W)) origin_pos.y -= origin_spd;
+        if (IsKeyDown(KEY_A)) origin_pos.x -= origin_spd;
+        if (IsKeyDown(KEY_S)) origin_pos.y += origin_spd;
+        if (IsKeyDown(KEY_D)) origin_pos.x += origin_spd;
+        
+        target_pos = GetMousePosition();
+
+        const int tile_x = (int)(target_pos.x / tile_size);
+        const int tile_y = (int)(target_pos.y / tile_size);
+
+        if
+        (
+            tile_x >= 0 && tile_x < map_cols &&
+            tile_y >= 0 && tile_y < map_rows
+        ) {
+            if (IsMouseButtonDown(MOUSE_LEFT_BUTTON)) {
+                editMapCell(&editor, tile_x, tile_y, brushes[brush]);
+            } else if (IsMouseButtonDown(MOUSE_RIGHT_BUTTON)) {
+                editMapCell(&editor, tile_x, tile_y, 0);
+            }
+        }
+
+        if (IsKeyPressed(KEY_F)) fan_mode = (fan_mode + 1) % FAN_MODE_COUNT;
+        if (IsKeyPressed(KEY_V)) show_cone = !show_cone;
+        if (IsKeyPressed(KEY_N)) show_nearest = !show_nearest;
+        if (IsKeyPressed(KEY_Q)) show_quad_tree = !show_quad_tree;
+        if (IsKeyPressed(KEY_T)) brush = (brush + 1) % brush_count;
+        if (IsKeyPressed(KEY_M)) show_memory = !show_memory;
+
+        if (IsKeyPressed(KEY_C)) editMapRect(&editor, 0, 0, map_cols - 1, map_rows - 1, 0);
+
+        if (IsKeyPressed(KEY_I) && importMapImage(map_path, import_map, map_rows, map_cols, &map_rule)) {
+            applyMapDiff(&editor, import_map, import_chunk_size);
+        }
+        if (IsKeyPressed(KEY_O)) exportMapImage(map_path, map, map_rows, map_cols, &map_rule);
+
+        if (IsKeyPressed(KEY_H)) {
+            if (is_hot_reloading) {
+                destroyMapWatcher(&map_watcher);
+            } else {
+                map_watcher = createMapWatcher(map_path);
+                reloaded_chunks = 0;
+            }
+            // stays off where the file can't be watched
+            is_hot_reloading = map_watcher.fd >= 0;
+        }
+        if
+        (
+            is_hot_reloading &&
+            pollMapWatcher(&map_watcher) &&
+            importMapImage(map_path, import_map, map_rows, map_cols, &map_rule)
+        ) {
+            reloaded_chunks = applyMapDiff(&editor, import_map, import_chunk_size);
+        }
+
+        flushMapEdits(&editor);
+
+        const Vector2 ray_dir = Vector2Normalize(Vector2Subtract(target_pos, origin_pos));
+
+        // the mouse ray is a sight line, it goes through windows
+        const float intersection_distance = castRayDDAHit(
+            origin_pos,
+            ray_dir,
+            map,
+            map_rows,
+            map_cols,
+            tile_size,
+            max_ray_len,
+            LAYER_VISION
+        ).distance;
+
+        ray_pos = Vector2Add(origin_pos, Vector2Scale(ray_dir, intersection_distance));
+
+        if (fan_mode != FAN_OFF) fan_rays = allocArena(&frame_arena, sizeof (FanRay) * fan_max_rays);
+        if (fan_mode == FAN_ADAPTIVE) {
+            fan_ray_count = castAdaptiveFan(
+                origin_pos,
+                map,
+                map_rows,
+                map_cols,
+                tile_size,
+                max_ray_len,
+                fan_coarse_count,
+                fan_angle_tolerance,
+                tile_size,
+                fan_rays,
+                fan_max_rays,
+                &fan_rays_cast
+            );
+        } else if (fan_mode == FAN_CACHED) {
+            resetRayCacheStats(&fan_cache);
+            for (int i = 0; i < cached_fan_count; i++) {
+                const float angle = 2.0f * PI * (float)i / (float)cached_fan_count;
+                const Vector2 direction = { cosf(angle), sinf(angle) };
+                const RayHit hit = castRayCached(
+                    &fan_cache,
+                    i,
+                    origin_pos,
+                    direction,
+                    map,
+                    map_rows,
+                    map_cols,
+                    tile_size,
+                    max_ray_len,
+                    &occ
+                );
+                fan_rays[i] = (FanRay){
+                    .angle = angle,
+                    .end_pos = Vector2Add(origin_pos, Vector2Scale(direction, hit.distance)),
+                    .hit = hit,
+                };
+            }
+            fan_ray_count = cached_fan_count;
+        }
+
+        if (show_cone) {
+            RayHit cone_hit;
+            cone_has_wall = queryWedge(
+                origin_pos,
+                ray_dir,
+                cone_half_angle,
+                cone_range,
+                map,
+                map_rows,
+                map_cols,
+                tile_size,
+                LAYER_VISION,
+                &cone_hit,
+                &cone_hit_pos
+            );
+            is_target_visible = isTargetVisible(
+                origin_pos,
+                ray_dir,
+                cone_half_angle,
+                cone_range,
+                target_pos,
+                5.0f,
+                map,
+                map_rows,
+                map_cols,
+                tile_size,
+                LAYER_VISION
+            );
+        }
+
+        if (show_nearest) {
+            RayHit nearest;
+            has_nearest = queryNearestWall(
+                &distance_field,
+                origin_pos,
+                nearest_radius,
+                tile_size,
+                &nearest,
+                &nearest_pos
+            );
+        }
+
+        BeginDrawing();
+
+        ClearBackground(BLACK);
+
+        // draw the area lit by the ray fan
+        if (fan_mode != FAN_OFF) {
+            for (int i = 0; i < fan_ray_count; i++) {
+                const FanRay* a = &fan_rays[i];
+                const FanRay* b = &fan_rays[(i + 1) % fan_ray_count];
+                DrawTriangle(origin_pos, b->end_pos, a->end_pos, Fade(ORANGE, 0.3f));
+                DrawCircleV(a->end_pos, 1.5f, ORANGE);
+            }
+        }
+
+        // draw the view cone, red if there is a wall inside of it
+        if (show_cone) {
+            const float cone_angle = atan2f(ray_dir.y, ray_dir.x) * RAD2DEG;
+            DrawCircleSector(
+                origin_pos,
+                cone_range,
+                cone_angle - cone_half_angle * RAD2DEG,
+                cone_angle + cone_half_angle * RAD2DEG,
+                16,
+                Fade(cone_has_wall ? RED : GREEN, 0.25f)
+            );
+        }
+
+        // draw horizontal grid lines
+        for (int i = 0; i < map_rows; i++) {
+            DrawLine(0, i * (int)tile_size, screen_width, i * (int)tile_size, GRAY);
+        }
+        // draw vertical grid lines
+        for (int i = 0; i < map_cols; i++) {
+            DrawLine(i* (int)tile_size, 0, i * (int)tile_size, screen_height, GRAY);
+        }
+        // draw tiles
+        updateTileMesh(&tile_mesh, map);
+        drawTileMesh(&tile_mesh, tile_size, WHITE);
+        drawShapedCells(&tile_mesh, map, tile_size, WHITE, SKYBLUE);
+        // draw the leaves of the quadtree
+        if (show_quad_tree) drawQuadTree(&quad_tree, tile_size, SKYBLUE);
+        // draw line from origin to target
+        DrawLineV(origin_pos, target_pos, YELLOW);      
+        // draw line that continues after target
+        drawDottedLine(
+            target_pos,
+            Vector2Add(target_pos, Vector2Scale(ray_dir, 100.0f * max_ray_len)),
+            YELLOW
+        );
+        // draw origin
+        DrawCircleV(origin_pos, 5.0f, RED);
+        // draw target, dimmed while the view cone can't see it
+        DrawCircleV(target_pos, 5.0f, (!show_cone || is_target_visible) ? GREEN : DARKGREEN);
+        // draw the point of the nearest wall inside the view cone
+        if (show_cone && cone_has_wall) {
+            DrawLineV(origin_pos, cone_hit_pos, RED);
+            DrawCircleV(cone_hit_pos, 4.0f, RED);
+        }
+        // draw the closest point of the nearest wall around the origin
+        if (show_nearest) {
+            DrawCircleLinesV(origin_pos, nearest_radius, PURPLE);
+            if (has_nearest) {
+                DrawLineV(origin_pos, nearest_pos, PURPLE);
+                DrawCircleV(nearest_pos, 4.0f, PURPLE);
+            }
+        }
+        // draw raycast intersection point
+        DrawCircleV(ray_pos, 2.0f, BLUE);
+        DrawCircleLinesV(ray_pos, 6.0f, BLUE);
+
+        // draw text
+        const int font_size = 20;
+        const int margin = 5;
+
+        const int buf_size = 50;
+
+        char ori_buf[buf_size];
+        snprintf(ori_buf, buf_size, "ORI: %.1f / %.1f", origin_pos.x, origin_pos.y);
+
+        char tar_buf[buf_size];
+        snprintf(tar_buf, buf_size, "TAR: %.1f / %.1f", target_pos.x, target_pos.y);
+
+        char ray_buf[buf_size];
+        snprintf(ray_buf, buf_size, "RAY: %.1f / %.1f", ray_pos.x, ray_pos.y);
+
+        char len_buf[buf_size];
+        snprintf(len_buf, buf_size, "LEN: %.4f", intersection_distance);
+
+        DrawRectangle(
+            0,
+            0,
+            220,
+            5 + 4 * font_size + 4 * margin,
+            BLACK
+        );
+        DrawText(ori_buf, 5, 5, font_size, RED);
+        DrawText(tar_buf, 5, 5 + font_size + margin, font_size, GREEN);
+        DrawText(ray_buf, 5, 5 + 2 * font_size + 2 * margin, font_size, BLUE);
+        DrawText(len_buf, 5, 5 + 3 * font_size + 3 * margin, font_size, YELLOW);
+
+        if (fan_mode != FAN_OFF) {
+            char fan_buf[buf_size];
+            if (fan_mode == FAN_ADAPTIVE) {
+                snprintf(
+                    fan_buf,
+                    buf_size,
+                    "FAN: %d rays, %d saved",
+                    fan_rays_cast,
+                    fan_dense_count - fan_rays_cast
+                );
+            } else {
+                snprintf(
+                    fan_buf,
+                    buf_size,
+                    "FAN: %.1f%% reused",
+                    100.0f * getRayCacheReuseRatio(&fan_cache)
+                );
+            }
+
+            DrawRectangle(0, 5 + 4 * font_size + 4 * margin, 260, font_size + margin, BLACK);
+            DrawText(fan_buf, 5, 5 + 4 * font_size + 4 * margin, font_size, ORANGE);
+        }
+
+        if (show_memory) {
+            MemoryReport report = { 0 };
+            addMemoryEntry(&report, "map", getMapBytes(map_rows, map_cols));
+            addMemoryEntry(&report, "occupancy", getOccupancyBlocksBytes(&occ));
+            addMemoryEntry(&report, "distance_field", getDistanceFieldBytes(&distance_field));
+            addMemoryEntry(&report, "quadtree", getQuadTreeBytes(&quad_tree));
+            addMemoryEntry(&report, "tile_mesh", getTileMeshBytes(&tile_mesh));
+            addMemoryEntry(&report, "ray_cache", getRayCacheBytes(&fan_cache));
+            addMemoryEntry(&report, "frame_arena", getArenaBytes(&frame_arena));
+            addMemoryEntry(&report, "editor", getMapEditorBytes(&editor));
+            addMemoryEntry(&report, "import_map", getMapBytes(map_rows, map_cols));
+            drawMemoryPanel(&report, frame_allocs, 0, 5 + 5 * font_size + 5 * margin, font_size, margin);
+        }
+
+        if (is_hot_reloading) {
+            char reload_buf[buf_size];
+            snprintf(reload_buf, buf_size, "RELOAD: %d chunks changed", reloaded_chunks);
+
+            DrawRectangle(0, screen_height - font_size - 2 * margin, 320, font_size + 2 * margin, BLACK);
+            DrawText(reload_buf, 5, screen_height - font_size - margin, font_size, LIME);
+        }
+
+        const int tooltip_x = screen_width - 280;
+
+        DrawRectangle(
+            tooltip_x - 5,
+            0,
+            285,
+            5 + 14 * font_size + 14 * margin,
+            BLACK
+        );
+        DrawText(
+            "[wasd] to move origin",
+            tooltip_x,
             5,
             font_size,
             WHITE
         );
-        DrawText(
-            "[mouse] to move target",
-            tooltip_x,
-            5 + font_size + margin,
-            font_size,
-            WHITE
+        DrawText(
+            "[mouse] to move target",
+            tooltip_x,
+            5 + font_size + margin,
+            font_size,
+            WHITE
+        );
+        DrawText(
+            "[left click] to paint tile",
+            tooltip_x,
+            5 + 2 * font_size + 2 * margin,
+            font_size,
+            WHITE
+        );
+        DrawText(
+            "[right click] to remove tile",
+            tooltip_x,
+            5 + 3 * font_size + 3 * margin,
+            font_size,
+            WHITE
+        );
+        DrawText(
+            "[c] to clear tiles",
+            tooltip_x,
+            5 + 4 * font_size + 4 * margin,
+            font_size,
+            WHITE
+        );
+        DrawText(
+            "[f] to cycle ray fan",
+            tooltip_x,
+            5 + 5 * font_size + 5 * margin,
+            font_size,
+            WHITE
+        );
+        DrawText(
+            "[v] to toggle view cone",
+            tooltip_x,
+            5 + 6 * font_size + 6 * margin,
+            font_size,
+            WHITE
+        );
+        DrawText(
+            "[n] to toggle nearest wall",
+            tooltip_x,
+            5 + 7 * font_size + 7 * margin,
+            font_size,
+            WHITE
+        );
+        DrawText(
+            "[q] to toggle quadtree",
+            tooltip_x,
+            5 + 8 * font_size + 8 * margin,
+            font_size,
+            WHITE
+        );
+        DrawText(
+            "[t] to cycle brush",
+            tooltip_x,
+            5 + 9 * font_size + 9 * margin,
+            font_size,
+            WHITE
+        );
+        DrawText(
+            "[m] to toggle memory panel",
+            tooltip_x,
+            5 + 10 * font_size + 10 * margin,
+            font_size,
+            WHITE
+        );
+        DrawText(
+            "[i] to import map image",
+            tooltip_x,
+            5 + 11 * font_size + 11 * margin,
+            font_size,
+            WHITE
+        );
+        DrawText(
+            "[o] to export map image",
+            tooltip_x,
+            5 + 12 * font_size + 12 * margin,
+            font_size,
+            WHITE
+        );
+        DrawText(
+            "[h] to toggle hot reload",
+            tooltip_x,
+            5 + 13 * font_size + 13 * margin,
+            font_size,
+            WHITE
+        );
+
+        EndDrawing();
+    }
+
+    // uninitialize
+    destroyMapWatcher(&map_watcher);
+    destroyArena(&frame_arena);
+    destroyRayCache(&fan_cache);
+    destroyOccupancyBlocks(&occ);
+    destroyDistanceField(&distance_field);
+    destroyQuadTree(&quad_tree);
+    destroyTileMesh(&tile_mesh);
+
+    destroyMap(import_map, map_rows);
+    destroyMap(map, map_rows);
+
+    CloseWindow();
+    return EXIT_SUCCESS;
+}
+
+void drawDottedLine(Vector2 start_pos, Vector2 end_pos, Color color) {
+    const float len = 4.0f;
+    const Vector2 dir = Vector2Normalize(Vector2Subtract(end_pos, start_pos));
+    const float full_distance = Vector2Distance(start_pos, end_pos);
+    const int steps = (int)(full_distance / (len * 2.0f));
+
+    for (int i = 0; i < steps; i++) {
+        start_pos = Vector2Add(start_pos, Vector2Scale(dir, len));
+        end_pos = Vector2Add(start_pos, Vector2Scale(dir, len));
+        if (i % 2 == 0) {
+            DrawLineV(start_pos, end_pos, color);
+        }
+    }
+}
+
+void drawQuadNode(const QuadTree* qt, int node, int x, int y, int size, float tile_size, Color color) {
+    const int first_child = qt->nodes[node].first_child;
+    if (first_child < 0) {
+        if (x < qt->map_cols && y < qt->map_rows) {
+            DrawRectangleLines(
+                (int)((float)x * tile_size),
+                (int)((float)y * tile_size),
+                (int)((float)size * tile_size),
+                (int)((float)size * tile_size),
+                color
+            );
+        }
+        return;
+    }
+
+    const int half = size / 2;
+    for (int i = 0; i < 4; i++) {
+        drawQuadNode(qt, first_child + i, x + (i & 1) * half, y + (i >> 1) * half, half, tile_size, color);
+    }
+}
+
+void drawQuadTree(const QuadTree* qt, float tile_size, Color color) {
+    drawQuadNode(qt, 0, 0, 0, qt->size, tile_size, color);
+}
+
+// draws all rectangles of the mesh as quads of a single vertex batch
+void drawTileMesh(const TileMesh* mesh, float tile_size, Color color) {
+    rlBegin(RL_QUADS);
+    rlColor4ub(color.r, color.g, color.b, color.a);
+
+    const int chunk_stride = mesh->chunk_size * mesh->chunk_size;
+    for (int chunk = 0; chunk < mesh->chunk_rows * mesh->chunk_cols; chunk++) {
+        const TileRect* rects = &mesh->rects[chunk * chunk_stride];
+        for (int i = 0; i < mesh->rect_counts[chunk]; i++) {
+            const float x0 = (float)rects[i].x * tile_size;
+            const float y0 = (float)rects[i].y * tile_size;
+            const float x1 = (float)(rects[i].x + rects[i].width) * tile_size;
+            const float y1 = (float)(rects[i].y + rects[i].height) * tile_size;
+
+            // counter-clockwise, starting at the top left corner
+            rlVertex2f(x0, y0);
+            rlVertex2f(x0, y1);
+            rlVertex2f(x1, y1);
+            rlVertex2f(x1, y0);
+        }
+    }
+
+    rlEnd();
+}
+
+// draws the cells the tile mesh leaves out, slopes as triangles in color and full cells
+// that can be seen through as squares in window_color
+// only the shaped cells collected by updateTileMesh are visited, the mesh has to be up to date
+void drawShapedCells(const TileMesh* mesh, int** map, float tile_size, Color color, Color window_color) {
+    rlBegin(RL_TRIANGLES);
+
+    const int chunk_stride = mesh->chunk_size * mesh->chunk_size;
+    for (int chunk = 0; chunk < mesh->chunk_rows * mesh->chunk_cols; chunk++) {
+        const TileRect* shaped = &mesh->rects[(chunk + 1) * chunk_stride - mesh->shaped_counts[chunk]];
+        for (int i = 0; i < mesh->shaped_counts[chunk]; i++) {
+            const int x = shaped[i].x;
+            const int y = shaped[i].y;
+
+            const Vector2 top_left = { (float)x * tile_size, (float)y * tile_size };
+            const Vector2 top_right = { (float)(x + 1) * tile_size, (float)y * tile_size };
+            const Vector2 bottom_left = { (float)x * tile_size, (float)(y + 1) * tile_size };
+            const Vector2 bottom_right = { (float)(x + 1) * tile_size, (float)(y + 1) * tile_size };
+
+            if ((map[y][x] >> CELL_SHAPE_SHIFT) == SHAPE_FULL) {
+                // two triangles, counter-clockwise
+                rlColor4ub(window_color.r, window_color.g, window_color.b, window_color.a);
+                rlVertex2f(top_left.x, top_left.y);
+                rlVertex2f(bottom_left.x, bottom_left.y);
+                rlVertex2f(bottom_right.x, bottom_right.y);
+                rlVertex2f(top_left.x, top_left.y);
+                rlVertex2f(bottom_right.x, bottom_right.y);
+                rlVertex2f(top_right.x, top_right.y);
+                continue;
+            }
+
+            // the solid corner first, then the other two corners counter-clockwise
+            Vector2 corners[3];
+            switch (map[y][x] >> CELL_SHAPE_SHIFT) {
+            case SHAPE_SLOPE_NW:
+                corners[0] = top_left;
+                corners[1] = bottom_left;
+                corners[2] = top_right;
+                break;
+            case SHAPE_SLOPE_NE:
+                corners[0] = top_right;
+                corners[1] = top_left;
+                corners[2] = bottom_right;
+                break;
+            case SHAPE_SLOPE_SW:
+                corners[0] = bottom_left;
+                corners[1] = bottom_right;
+                corners[2] = top_left;
+                break;
+            default:
+                corners[0] = bottom_right;
+                corners[1] = top_right;
+                corners[2] = bottom_left;
+                break;
+            }
+            rlColor4ub(color.r, color.g, color.b, color.a);
+            for (int i = 0; i < 3; i++) rlVertex2f(corners[i].x, corners[i].y);
+        }
+    }
+
+    rlEnd();
+}
+
+// draws one line per entry of the report, then the total and the heap allocations of the
+// last frame, with the top left corner at x/y
+void drawMemoryPanel(const MemoryReport* report, long long frame_allocs, int x, int y, int font_size, int margin) {
+    const int line_count = report->count + 2;
+    DrawRectangle(x, y, 300, 5 + line_count * (font_size + margin), BLACK);
+
+    const int buf_size = 50;
+    char buf[buf_size];
+    for (int i = 0; i < report->count; i++) {
+        snprintf(buf, buf_size, "%s: %.1f KiB", report->names[i], (double)report->bytes[i] / 1024.0);
+        DrawText(buf, x + 5, y + 5 + i * (font_size + margin), font_size, LIGHTGRAY);
+    }
+
+    snprintf(buf, buf_size, "TOTAL: %.1f KiB", (double)report->total_bytes / 1024.0);
+    DrawText(buf, x + 5, y + 5 + report->count * (font_size + margin), font_size, WHITE);
+
+    snprintf(buf, buf_size, "ALLOCS: %lld last frame", frame_allocs);
+    DrawText(
+        buf,
+        x + 5,
+        y + 5 + (report->count + 1) * (font_size + margin),
+        font_size,
+        (frame_allocs > 0) ? RED : GREEN
+    );
+}
+
+// xorshift32, small and deterministic so benchmark runs are repeatable
+// state must never be 0
+uint32_t nextRandom(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// returns a random float in the range [0, 1)
+float nextRandomFloat(uint32_t* state) {
+    return (float)(nextRandom(state) >> 8) / 16777216.0f;
+}
+
+// the benchmark corpus: deterministic generators for map layouts that each favour or hurt
+// different traversals, every generator overwrites the whole map and only depends on seed
+
+// sets the cells of the rectangle from x0/y0 to x1/y1 (both inclusive) to value
+void fillMapRect(int** map, int x0, int y0, int x1, int y1, int value) {
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) map[y][x] = value;
+    }
+}
+
+// walls scattered with the same chance everywhere
+void generateUniformMap(int** map, int map_rows, int map_cols, uint32_t seed) {
+    const float density = 0.05f;
+    uint32_t rng = seed | 1;
+    for (int y = 0; y < map_rows; y++) {
+        for (int x = 0; x < map_cols; x++) {
+            map[y][x] = (nextRandomFloat(&rng) < density) ? CELL_SOLID : CELL_OPEN;
+        }
+    }
+}
+
+// a map with one bit per cell, 64 cells to a word with the lowest bit for the leftmost
+// cell, every row starts at a new word
+typedef struct BitGrid {
+    int rows;
+    int cols;
+    int words_per_row;
+    uint64_t* bits;
+} BitGrid;
+
+BitGrid createBitGrid(int rows, int cols) {
+    BitGrid grid = { .rows = rows, .cols = cols, .words_per_row = (cols + 63) / 64 };
+    grid.bits = heapCalloc((size_t)rows * (size_t)grid.words_per_row, sizeof (uint64_t));
+    return grid;
+}
+
+void destroyBitGrid(BitGrid* grid) {
+    heapFree(grid->bits);
+    *grid = (BitGrid){ 0 };
+}
+
+// one step of the cave automaton from src to dst, see generateCaveMap
+typedef struct CaveStep {
+    const BitGrid* src;
+    BitGrid* dst;
+} CaveStep;
+
+// returns word i of row y, everything outside the map reads as walls
+static inline uint64_t getCaveWord(const BitGrid* grid, int y, int i) {
+    if (y < 0 || y >= grid->rows || i < 0 || i >= grid->words_per_row) return ~(uint64_t)0;
+    uint64_t word = grid->bits[(size_t)y * grid->words_per_row + i];
+    // the bits past the last column are outside the map as well
+    const int tail = grid->cols - i * 64;
+    if (tail < 64) word |= ~(uint64_t)0 << tail;
+    return word;
+}
+
+// the three words of row y around word i with each cell moved onto its left and right
+// neighbour, so bit j of west is the cell left of bit j and bit j of east the one right of it
+static inline void getCaveNeighbours(const BitGrid* grid, int y, int i, uint64_t* center, uint64_t* west, uint64_t* east) {
+    *center = getCaveWord(grid, y, i);
+    *west = (*center << 1) | (getCaveWord(grid, y, i - 1) >> 63);
+    *east = (*center >> 1) | (getCaveWord(grid, y, i + 1) << 63);
+}
+
+// runs the automaton on rows [begin, end) of the destination, 64 cells at a time
+// the 8 neighbour bits of every cell are summed into a 4 bit count whose bits are each held
+// in a word of their own (bitsliced), by an adder tree of full and half adders
+void stepCaveRows(void* ctx, int begin, int end) {
+    const CaveStep* step = ctx;
+    const BitGrid* src = step->src;
+
+    for (int y = begin; y < end; y++) {
+        uint64_t* dst_row = &step->dst->bits[(size_t)y * step->dst->words_per_row];
+        for (int i = 0; i < src->words_per_row; i++) {
+            uint64_t n, nw, ne, cur, w, e, s, sw, se;
+            getCaveNeighbours(src, y - 1, i, &n, &nw, &ne);
+            getCaveNeighbours(src, y, i, &cur, &w, &e);
+            getCaveNeighbours(src, y + 1, i, &s, &sw, &se);
+
+            // weight 1: two full adders and a half adder, then a full adder of their sums
+            const uint64_t sum_a = n ^ nw ^ ne;
+            const uint64_t carry_a = (n & nw) | (ne & (n ^ nw));
+            const uint64_t sum_b = w ^ e ^ s;
+            const uint64_t carry_b = (w & e) | (s & (w ^ e));
+            const uint64_t sum_c = sw ^ se;
+            const uint64_t carry_c = sw & se;
+            const uint64_t bit0 = sum_a ^ sum_b ^ sum_c;
+            const uint64_t carry_d = (sum_a & sum_b) | (sum_c & (sum_a ^ sum_b));
+
+            // weight 2: the four carries of the adders above
+            const uint64_t sum_e = carry_a ^ carry_b ^ carry_c;
+            const uint64_t carry_e = (carry_a & carry_b) | (carry_c & (carry_a ^ carry_b));
+            const uint64_t bit1 = sum_e ^ carry_d;
+            const uint64_t carry_f = sum_e & carry_d;
+
+            // weight 4 and 8
+            const uint64_t bit2 = carry_e ^ carry_f;
+            const uint64_t bit3 = carry_e & carry_f;
+
+            // at least 5 walls around, or exactly 4 around a wall
+            const uint64_t at_least_5 = bit3 | (bit2 & (bit1 | bit0));
+            const uint64_t exactly_4 = bit2 & ~bit1 & ~bit0 & ~bit3;
+            dst_row[i] = at_least_5 | (exactly_4 & cur);
+        }
+
+        // keep the bits past the last column clear
+        const int tail = src->cols - (src->words_per_row - 1) * 64;
+        if (tail < 64) dst_row[src->words_per_row - 1] &= ~(~(uint64_t)0 << tail);
+    }
+}
+
+// one step of the cave automaton on every cell of src into dst, split into bands of rows
+// across the parallelFor workers
+void stepCaveAutomaton(const BitGrid* src, BitGrid* dst) {
+    CaveStep step = { .src = src, .dst = dst };
+    parallelFor(src->rows, 64, stepCaveRows, &step);
+}
+
+// writes count (at most 64) cells from the bits of a word, walls become CELL_SOLID
+// a full word has each of its bytes spread over eight flag bytes with a multiply and a mask
+// first, so the cells are written by one loop without shifts that the compiler vectorizes
+static inline void unpackWallWord(uint64_t word, int count, int* cells) {
+    if (count < 64) {
+        for (int k = 0; k < count; k++) cells[k] = ((word >> k) & 1) ? CELL_SOLID : CELL_OPEN;
+        return;
+    }
+
+    uint8_t flags[64];
+    for (int k = 0; k < 64; k += 8) {
+        const uint64_t eight = (((word >> k) & 0xff) * 0x0101010101010101ull) & 0x8040201008040201ull;
+        memcpy(&flags[k], &eight, sizeof eight);
+    }
+    for (int k = 0; k < 64; k++) cells[k] = flags[k] ? CELL_SOLID : CELL_OPEN;
+}
+
+// writes the cells of a bit grid to a map of the same size, walls become CELL_SOLID
+typedef struct BitGridCopy {
+    const BitGrid* grid;
+    int** map;
+} BitGridCopy;
+
+void unpackBitGridRows(void* ctx, int begin, int end) {
+    const BitGridCopy* copy = ctx;
+    const BitGrid* grid = copy->grid;
+    for (int y = begin; y < end; y++) {
+        const uint64_t* row = &grid->bits[(size_t)y * grid->words_per_row];
+        for (int i = 0; i < grid->words_per_row; i++) {
+            const int count = (grid->cols - i * 64 < 64) ? grid->cols - i * 64 : 64;
+            unpackWallWord(row[i], count, &copy->map[y][i * 64]);
+        }
+    }
+}
+
+void unpackBitGrid(const BitGrid* grid, int** map) {
+    BitGridCopy copy = { .grid = grid, .map = map };
+    parallelFor(grid->rows, 64, unpackBitGridRows, &copy);
+}
+
+// winding caves from a random fill smoothed by a cellular automaton: a cell becomes a
+// wall with at least 5 wall neighbours, and stays one with at least 4, cells outside the
+// map count as walls
+// the automaton runs on packed rows, see stepCaveRows
+void generateCaveMap(int** map, int map_rows, int map_cols, uint32_t seed) {
+    const float fill = 0.45f;
+    const int step_count = 4;
+
+    BitGrid grid = createBitGrid(map_rows, map_cols);
+    BitGrid next = createBitGrid(map_rows, map_cols);
+
+    uint32_t rng = seed | 1;
+    for (int y = 0; y < map_rows; y++) {
+        uint64_t* row = &grid.bits[(size_t)y * grid.words_per_row];
+        for (int x = 0; x < map_cols; x++) {
+            if (nextRandomFloat(&rng) < fill) row[x >> 6] |= (uint64_t)1 << (x & 63);
+        }
+    }
+
+    for (int step = 0; step < step_count; step++) {
+        stepCaveAutomaton(&grid, &next);
+        const BitGrid swap = grid;
+        grid = next;
+        next = swap;
+    }
+    unpackBitGrid(&grid, map);
+
+    destroyBitGrid(&next);
+    destroyBitGrid(&grid);
+}
+
+// carves an L shaped corridor from x0/y0 to x1/y1, first along x and then along y
+void carveCorridor(int** map, int x0, int y0, int x1, int y1) {
+    fillMapRect(map, (x0 < x1) ? x0 : x1, y0, (x0 < x1) ? x1 : x0, y0, CELL_OPEN);
+    fillMapRect(map, x1, (y0 < y1) ? y0 : y1, x1, (y0 < y1) ? y1 : y0, CELL_OPEN);
+}
+
+// splits the rectangle from x0/y0 to x1/y1 (exclusive) until both sides are below
+// 2 * min_size, carves a room into every leaf and joins the halves of every split with a
+// corridor between one room of each
+// room_x/room_y receive the center of a room inside the rectangle
+void splitBspRooms(int** map, int x0, int y0, int x1, int y1, int min_size, uint32_t* rng, int* room_x, int* room_y) {
+    const int width = x1 - x0;
+    const int height = y1 - y0;
+
+    if (width < 2 * min_size && height < 2 * min_size) {
+        // at least one wall cell between neighbouring rooms
+        const int room_width = min_size / 2 + (int)(nextRandom(rng) % (uint32_t)(width - min_size / 2 - 1));
+        const int room_height = min_size / 2 + (int)(nextRandom(rng) % (uint32_t)(height - min_size / 2 - 1));
+        const int left = x0 + 1 + (int)(nextRandom(rng) % (uint32_t)(width - room_width));
+        const int top = y0 + 1 + (int)(nextRandom(rng) % (uint32_t)(height - room_height));
+        fillMapRect(map, left, top, left + room_width - 2, top + room_height - 2, CELL_OPEN);
+        *room_x = left + (room_width - 2) / 2;
+        *room_y = top + (room_height - 2) / 2;
+        return;
+    }
+
+    int ax, ay, bx, by;
+    if (width >= height) {
+        const int split = x0 + min_size + (int)(nextRandom(rng) % (uint32_t)(width - 2 * min_size + 1));
+        splitBspRooms(map, x0, y0, split, y1, min_size, rng, &ax, &ay);
+        splitBspRooms(map, split, y0, x1, y1, min_size, rng, &bx, &by);
+    } else {
+        const int split = y0 + min_size + (int)(nextRandom(rng) % (uint32_t)(height - 2 * min_size + 1));
+        splitBspRooms(map, x0, y0, x1, split, min_size, rng, &ax, &ay);
+        splitBspRooms(map, x0, split, x1, y1, min_size, rng, &bx, &by);
+    }
+    carveCorridor(map, ax, ay, bx, by);
+    *room_x = ax;
+    *room_y = ay;
+}
+
+// rooms of all sizes joined by one cell wide corridors, from a binary space partition
+void generateBspRoomsMap(int** map, int map_rows, int map_cols, uint32_t seed) {
+    const int min_size = 12;
+
+    uint32_t rng = seed | 1;
+    fillMapRect(map, 0, 0, map_cols - 1, map_rows - 1, CELL_SOLID);
+    if (map_rows < min_size || map_cols < min_size) return;
+    int room_x, room_y;
+    splitBspRooms(map, 0, 0, map_cols, map_rows, min_size, &rng, &room_x, &room_y);
+}
+
+// a perfect maze with one cell wide corridors from a depth first search, the corridors run
+// through the cells with odd coordinates
+void generateMazeMap(int** map, int map_rows, int map_cols, uint32_t seed) {
+    const int maze_rows = (map_rows - 1) / 2;
+    const int maze_cols = (map_cols - 1) / 2;
+
+    uint32_t rng = seed | 1;
+    fillMapRect(map, 0, 0, map_cols - 1, map_rows - 1, CELL_SOLID);
+    if (maze_rows < 1 || maze_cols < 1) return;
+
+    // the search path as maze cell indices, the maze cells are open once visited
+    int* stack = heapAlloc(sizeof (int) * (size_t)maze_rows * (size_t)maze_cols);
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    map[1][1] = CELL_OPEN;
+
+    while (stack_size > 0) {
+        const int cell = stack[stack_size - 1];
+        const int mx = cell % maze_cols;
+        const int my = cell / maze_cols;
+
+        // pick one of the unvisited neighbours at random
+        int choices[4];
+        int choice_count = 0;
+        for (int d = 0; d < 4; d++) {
+            const int nx = mx + face_normal_x[d];
+            const int ny = my + face_normal_y[d];
+            if (nx < 0 || nx >= maze_cols || ny < 0 || ny >= maze_rows) continue;
+            if (map[2 * ny + 1][2 * nx + 1] == CELL_OPEN) continue;
+            choices[choice_count++] = d;
+        }
+        if (choice_count == 0) {
+            stack_size--;
+            continue;
+        }
+
+        const int d = choices[nextRandom(&rng) % (uint32_t)choice_count];
+        const int nx = mx + face_normal_x[d];
+        const int ny = my + face_normal_y[d];
+        map[2 * my + 1 + face_normal_y[d]][2 * mx + 1 + face_normal_x[d]] = CELL_OPEN;
+        map[2 * ny + 1][2 * nx + 1] = CELL_OPEN;
+        stack[stack_size++] = ny * maze_cols + nx;
+    }
+    heapFree(stack);
+}
+
+// small square pillars on a jittered grid with a lot of open space in between
+void generatePillarsMap(int** map, int map_rows, int map_cols, uint32_t seed) {
+    const int spacing = 12;
+
+    uint32_t rng = seed | 1;
+    fillMapRect(map, 0, 0, map_cols - 1, map_rows - 1, CELL_OPEN);
+    for (int gy = 0; gy + spacing <= map_rows; gy += spacing) {
+        for (int gx = 0; gx + spacing <= map_cols; gx += spacing) {
+            if (nextRandomFloat(&rng) < 0.4f) continue;
+            const int size = 1 + (int)(nextRandom(&rng) % 3);
+            const int x = gx + (int)(nextRandom(&rng) % (uint32_t)(spacing - size));
+            const int y = gy + (int)(nextRandom(&rng) % (uint32_t)(spacing - size));
+            fillMapRect(map, x, y, x + size - 1, y + size - 1, CELL_SOLID);
+        }
+    }
+}
+
+// cuts [0, length) into blocks of random size separated by streets of random width,
+// writes the first and last cell of every block to starts/ends and returns the count
+int splitCityBlocks(int length, uint32_t* rng, int* starts, int* ends) {
+    int count = 0;
+    int pos = 0;
+    while (true) {
+        pos += 2 + (int)(nextRandom(rng) % 5);
+        const int size = 8 + (int)(nextRandom(rng) % 33);
+        if (pos + size > length) break;
+        starts[count] = pos;
+        ends[count] = pos + size - 1;
+        count++;
+        pos += size;
+    }
+    return count;
+}
+
+// solid city blocks of varying size between straight streets, some with an open courtyard
+void generateCityMap(int** map, int map_rows, int map_cols, uint32_t seed) {
+    uint32_t rng = seed | 1;
+    fillMapRect(map, 0, 0, map_cols - 1, map_rows - 1, CELL_OPEN);
+
+    // a block is at least 10 cells including its street, which bounds the counts
+    int* row_starts = heapAlloc(sizeof (int) * (map_rows / 10 + 1));
+    int* row_ends = heapAlloc(sizeof (int) * (map_rows / 10 + 1));
+    int* col_starts = heapAlloc(sizeof (int) * (map_cols / 10 + 1));
+    int* col_ends = heapAlloc(sizeof (int) * (map_cols / 10 + 1));
+    const int row_count = splitCityBlocks(map_rows, &rng, row_starts, row_ends);
+    const int col_count = splitCityBlocks(map_cols, &rng, col_starts, col_ends);
+
+    for (int r = 0; r < row_count; r++) {
+        for (int c = 0; c < col_count; c++) {
+            fillMapRect(map, col_starts[c], row_starts[r], col_ends[c], row_ends[r], CELL_SOLID);
+            const bool is_big = col_ends[c] - col_starts[c] >= 12 && row_ends[r] - row_starts[r] >= 12;
+            if (is_big && nextRandomFloat(&rng) < 0.3f) {
+                fillMapRect(map, col_starts[c] + 3, row_starts[r] + 3, col_ends[c] - 3, row_ends[r] - 3, CELL_OPEN);
+            }
+        }
+    }
+
+    heapFree(col_ends);
+    heapFree(col_starts);
+    heapFree(row_ends);
+    heapFree(row_starts);
+}
+
+typedef void (*MapGenerator)(int** map, int map_rows, int map_cols, uint32_t seed);
+
+typedef struct MapGeneratorInfo {
+    const char* name;
+    MapGenerator generate;
+} MapGeneratorInfo;
+
+const MapGeneratorInfo map_generators[] = {
+    { "uniform", generateUniformMap },
+    { "caves", generateCaveMap },
+    { "bsp_rooms", generateBspRoomsMap },
+    { "maze", generateMazeMap },
+    { "pillars", generatePillarsMap },
+    { "city", generateCityMap },
+};
+
+#define MAP_GENERATOR_COUNT ((int)(sizeof map_generators / sizeof map_generators[0]))
+
+// a pixel is darker than the threshold when its brightness (r + 2g + b) / 4 is below it,
+// pixels with less than half alpha are never walls
+static inline bool isWallPixel(const uint8_t* pixel, int threshold) {
+    return pixel[3] >= 128 && pixel[0] + 2 * pixel[1] + pixel[2] < 4 * threshold;
+}
+
+// returns which of count (at most 64) pixels of an R8G8B8A8 row are walls as the bits of
+// a word, the first pixel in the lowest bit
+// a full word is done in two passes: the first reads every pixel as one 32 bit lane and
+// tests it without a branch, so the compiler turns it into SIMD code, and the second
+// gathers the resulting flag bytes eight at a time into bits with one multiply (every
+// flag is 0 or 1, so the partial products of the multiply never overlap)
+// NOTE: the pixels are read little endian, so r is the lowest byte of a lane
+static inline uint64_t packWallPixels(const uint8_t* pixels, int count, int threshold) {
+    uint64_t word = 0;
+
+    if (count < 64) {
+        for (int k = 0; k < count; k++) {
+            if (isWallPixel(&pixels[k * 4], threshold)) word |= (uint64_t)1 << k;
+        }
+        return word;
+    }
+
+    uint8_t flags[64];
+    for (int k = 0; k < 64; k++) {
+        uint32_t pixel;
+        memcpy(&pixel, &pixels[k * 4], sizeof pixel);
+        const uint32_t sum = (pixel & 0xff) + ((pixel >> 7) & 0x1fe) + ((pixel >> 16) & 0xff);
+        flags[k] = (uint8_t)((pixel >> 31) & (sum < 4 * (uint32_t)threshold));
+    }
+    for (int k = 0; k < 64; k += 8) {
+        uint64_t eight;
+        memcpy(&eight, &flags[k], sizeof eight);
+        word |= ((eight * 0x0102040810204080ull) >> 56) << k;
+    }
+    return word;
+}
+
+// an R8G8B8A8 image on its way into a map, see convertImageToMap
+typedef struct ImageConversion {
+    const Image* image;
+    const MapImageRule* rule;
+    int** map;
+    int map_cols;
+} ImageConversion;
+
+// converts rows [begin, end) of the map 64 cells at a time, the walls of each 64 pixels
+// are packed into a word which is then written out while its pixels are still in the cache
+// the palette is looked up pixel by pixel, so it's meant for a handful of special cells
+void convertImageRows(void* ctx, int begin, int end) {
+    const ImageConversion* conversion = ctx;
+    const Image* image = conversion->image;
+    const MapImageRule* rule = conversion->rule;
+    const int width = (image->width < conversion->map_cols) ? image->width : conversion->map_cols;
+
+    for (int y = begin; y < end; y++) {
+        int* cells = conversion->map[y];
+        // the rows below the image and the cells right of it are open (CELL_OPEN is 0)
+        if (y >= image->height) {
+            memset(cells, 0, sizeof (int) * (size_t)conversion->map_cols);
+            continue;
+        }
+        if (width < conversion->map_cols) memset(&cells[width], 0, sizeof (int) * (size_t)(conversion->map_cols - width));
+
+        const uint8_t* pixels = (const uint8_t*)image->data + (size_t)y * (size_t)image->width * 4;
+        for (int x = 0; x < width; x += 64) {
+            const int count = (width - x < 64) ? width - x : 64;
+            unpackWallWord(packWallPixels(&pixels[(size_t)x * 4], count, rule->threshold), count, &cells[x]);
+        }
+
+        for (int x = 0; x < width && rule->palette_count > 0; x++) {
+            for (int i = 0; i < rule->palette_count; i++) {
+                if (memcmp(&pixels[(size_t)x * 4], &rule->palette[i].color, 4) != 0) continue;
+                cells[x] = rule->palette[i].cell;
+                break;
+            }
+        }
+    }
+}
+
+// writes the cells of an R8G8B8A8 image to a map, pixel x/y becomes cell x/y, the cells
+// outside of the image are open and the pixels outside of the map are dropped
+void convertImageToMap(const Image* image, int** map, int map_rows, int map_cols, const MapImageRule* rule) {
+    ImageConversion conversion = { .image = image, .rule = rule, .map = map, .map_cols = map_cols };
+    parallelFor(map_rows, 64, convertImageRows, &conversion);
+}
+
+// reads a map from any image raylib can load, see convertImageToMap
+// returns false when the image can't be loaded, the map is left alone then
+bool importMapImage(const char* path, int** map, int map_rows, int map_cols, const MapImageRule* rule) {
+    Image image = LoadImage(path);
+    // NOTE: not IsImageReady, it has been renamed between raylib versions
+    if (image.data == NULL) return false;
+
+    ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    convertImageToMap(&image, map, map_rows, map_cols, rule);
+    UnloadImage(image);
+    return true;
+}
+
+// writes a map to an image file with one pixel per cell, the format follows the file
+// extension (see ExportImage), returns false when it can't be written
+bool exportMapImage(const char* path, int** map, int map_rows, int map_cols, const MapImageRule* rule) {
+    Color* pixels = heapAlloc(sizeof (Color) * (size_t)map_rows * (size_t)map_cols);
+
+    for (int y = 0; y < map_rows; y++) {
+        for (int x = 0; x < map_cols; x++) {
+            Color color = (map[y][x] == CELL_OPEN) ? WHITE : BLACK;
+            for (int i = 0; i < rule->palette_count; i++) {
+                if (rule->palette[i].cell != map[y][x]) continue;
+                color = rule->palette[i].color;
+                break;
+            }
+            pixels[(size_t)y * map_cols + x] = color;
+        }
+    }
+
+    const Image image = {
+        .data = pixels,
+        .width = map_cols,
+        .height = map_rows,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+    const bool is_exported = ExportImage(image, path);
+
+    heapFree(pixels);
+    return is_exported;
+}
+
+// returns a monotonic timestamp in seconds
+double getTimeSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// prints one benchmark result as an element of the JSON array written by runBenchmarks
+// unit names what was counted, e.g. rays or cells
+void printBenchResult
+(
+    const char* name,
+    const char* unit,
+    long long count,
+    double seconds,
+    bool* is_first
+) {
+    printf(
+        "%s\n    { \"name\": \"%s\", \"unit\": \"%s\", \"count\": %lld, "
+        "\"seconds\": %.6f, \"per_sec\": %.0f }",
+        (*is_first) ? "" : ",",
+        name,
+        unit,
+        count,
+        seconds,
+        (seconds > 0.0) ? (double)count / seconds : 0.0
+    );
+    *is_first = false;
+}
+
+// prints a plain count without a time as an element of the JSON array written by
+// runBenchmarks
+void printBenchCount(const char* name, const char* unit, long long count, bool* is_first) {
+    printf(
+        "%s\n    { \"name\": \"%s\", \"unit\": \"%s\", \"count\": %lld }",
+        (*is_first) ? "" : ",",
+        name,
+        unit,
+        count
+    );
+    *is_first = false;
+}
+
+// prints the memory a structure takes up as an element of the JSON array written by
+// runBenchmarks
+void printBenchMemory(const char* name, size_t bytes, bool* is_first) {
+    printBenchCount(name, "bytes", (long long)bytes, is_first);
+}
+
+// casts the same random rays on a map with every traversal and prints the throughput
+// of each one together with the memory its data structure takes up
+// the results are named after map_name, e.g. rooms_dda
+void benchTraversals
+(
+    const char* map_name,
+    int** map,
+    int map_rows,
+    int map_cols,
+    uint32_t* rng,
+    bool* is_first
+) {
+    const float tile_size = 20.0f;
+    const float max_distance = 2000.0f * tile_size;
+    const int ray_count = 1 << 16;
+
+    Vector2* origins = heapAlloc(sizeof (Vector2) * ray_count);
+    Vector2* directions = heapAlloc(sizeof (Vector2) * ray_count);
+    float* distances = heapAlloc(sizeof (float) * ray_count);
+    for (int i = 0; i < ray_count; i++) {
+        const float angle = 2.0f * PI * nextRandomFloat(rng);
+        origins[i] = (Vector2){
+            nextRandomFloat(rng) * (float)map_cols * tile_size,
+            nextRandomFloat(rng) * (float)map_rows * tile_size,
+        };
+        directions[i] = (Vector2){ cosf(angle), sinf(angle) };
+    }
+
+    char name[64];
+    double start;
+
+    snprintf(name, sizeof name, "%s_dda", map_name);
+    start = getTimeSeconds();
+    castRayBatch(
+        origins,
+        directions,
+        ray_count,
+        map,
+        map_rows,
+        map_cols,
+        tile_size,
+        max_distance,
+        distances
+    );
+    printBenchResult(name, "rays", ray_count, getTimeSeconds() - start, is_first);
+    snprintf(name, sizeof name, "%s_grid_memory", map_name);
+    printBenchMemory(name, getMapBytes(map_rows, map_cols), is_first);
+
+    RayBatchScratch scratch = createRayBatchScratch(ray_count);
+    snprintf(name, sizeof name, "%s_dda_sorted", map_name);
+    start = getTimeSeconds();
+    castRayBatchSorted(
+        origins,
+        directions,
+        ray_count,
+        map,
+        map_rows,
+        map_cols,
+        tile_size,
+        max_distance,
+        &scratch,
+        distances
+    );
+    printBenchResult(name, "rays", ray_count, getTimeSeconds() - start, is_first);
+    destroyRayBatchScratch(&scratch);
+
+    snprintf(name, sizeof name, "%s_supercover", map_name);
+    start = getTimeSeconds();
+    for (int i = 0; i < ray_count; i++) {
+        distances[i] = castRaySupercover(
+            origins[i],
+            directions[i],
+            map,
+            map_rows,
+            map_cols,
+            tile_size,
+            max_distance,
+            LAYER_ALL
+        ).distance;
+    }
+    printBenchResult(name, "rays", ray_count, getTimeSeconds() - start, is_first);
+
+    SummedAreaTable sat = createSummedAreaTable(map, map_rows, map_cols, 32);
+    snprintf(name, sizeof name, "%s_sat_skip", map_name);
+    start = getTimeSeconds();
+    for (int i = 0; i < ray_count; i++) {
+        distances[i] = castRayDDASkip(
+            origins[i],
+            directions[i],
+            map,
+            map_rows,
+            map_cols,
+            tile_size,
+            max_distance,
+            &sat,
+            LAYER_ALL
+        ).distance;
+    }
+    printBenchResult(name, "rays", ray_count, getTimeSeconds() - start, is_first);
+    snprintf(name, sizeof name, "%s_sat_memory", map_name);
+    printBenchMemory(name, getSummedAreaTableBytes(&sat), is_first);
+    destroySummedAreaTable(&sat);
+
+    QuadTree qt = createQuadTree(map, map_rows, map_cols);
+    snprintf(name, sizeof name, "%s_quadtree", map_name);
+    start = getTimeSeconds();
+    for (int i = 0; i < ray_count; i++) {
+        distances[i] = castRayQuadTree(
+            origins[i],
+            directions[i],
+            &qt,
+            tile_size,
+            max_distance
+        ).distance;
+    }
+    printBenchResult(name, "rays", ray_count, getTimeSeconds() - start, is_first);
+    snprintf(name, sizeof name, "%s_quadtree_memory", map_name);
+    printBenchMemory(name, getQuadTreeBytes(&qt), is_first);
+    destroyQuadTree(&qt);
+
+    // the cache is filled by a first frame that isn't timed, the timed frame casts the same
+    // rays from origins moved by a fraction of a cell, like a walking player
+    OccupancyBlocks occ = createOccupancyBlocks(map, map_rows, map_cols, 8);
+    RayCache cache = createRayCache(ray_count);
+    for (int i = 0; i < ray_count; i++) {
+        castRayCached(
+            &cache,
+            i,
+            origins[i],
+            directions[i],
+            map,
+            map_rows,
+            map_cols,
+            tile_size,
+            max_distance,
+            &occ
+        );
+    }
+    resetRayCacheStats(&cache);
+    const Vector2 step = { 0.05f * tile_size, 0.03f * tile_size };
+    snprintf(name, sizeof name, "%s_cached", map_name);
+    start = getTimeSeconds();
+    for (int i = 0; i < ray_count; i++) {
+        distances[i] = castRayCached(
+            &cache,
+            i,
+            Vector2Add(origins[i], step),
+            directions[i],
+            map,
+            map_rows,
+            map_cols,
+            tile_size,
+            max_distance,
+            &occ
+        ).distance;
+    }
+    printBenchResult(name, "rays", ray_count, getTimeSeconds() - start, is_first);
+    snprintf(name, sizeof name, "%s_cached_reused", map_name);
+    printBenchCount(name, "rays", cache.reused, is_first);
+    snprintf(name, sizeof name, "%s_cached_memory", map_name);
+    printBenchMemory(name, getRayCacheBytes(&cache), is_first);
+    destroyRayCache(&cache);
+
+    // segments of up to 64 cells, about what a line of sight check between agents covers
+    int clear_count = 0;
+    snprintf(name, sizeof name, "%s_segment_occupancy", map_name);
+    start = getTimeSeconds();
+    for (int i = 0; i < ray_count; i++) {
+        clear_count += isSegmentClear(
+            origins[i],
+            directions[i],
+            (float)(i % 64 + 1) * tile_size,
+            map,
+            map_rows,
+            map_cols,
+            tile_size,
+            &occ
         );
-        DrawText(
-            "[left click] to paint tile",
-            tooltip_x,
-            5 + 2 * font_size + 2 * margin,
-            font_size,
-            WHITE
+    }
+    printBenchResult(name, "segments", ray_count, getTimeSeconds() - start, is_first);
+    snprintf(name, sizeof name, "%s_segment_occupancy_clear", map_name);
+    printBenchCount(name, "segments", clear_count, is_first);
+    snprintf(name, sizeof name, "%s_occupancy_memory", map_name);
+    printBenchMemory(name, getOccupancyBlocksBytes(&occ), is_first);
+    destroyOccupancyBlocks(&occ);
+
+    DistanceField df = createDistanceField(map, map_rows, map_cols);
+    int found_count = 0;
+    snprintf(name, sizeof name, "%s_nearest_wall", map_name);
+    start = getTimeSeconds();
+    for (int i = 0; i < ray_count; i++) {
+        RayHit nearest;
+        Vector2 nearest_pos;
+        found_count += queryNearestWall(&df, origins[i], 8.0f * tile_size, tile_size, &nearest, &nearest_pos);
+    }
+    printBenchResult(name, "queries", ray_count, getTimeSeconds() - start, is_first);
+    snprintf(name, sizeof name, "%s_nearest_wall_found", map_name);
+    printBenchCount(name, "queries", found_count, is_first);
+    snprintf(name, sizeof name, "%s_distance_field_memory", map_name);
+    printBenchMemory(name, getDistanceFieldBytes(&df), is_first);
+    destroyDistanceField(&df);
+
+    // the queries of an agent look around its own neighbourhood, so they get a short range
+    // instead of max_distance
+    const float agent_range = 64.0f * tile_size;
+
+    // adaptive fans from a subset of the origins, with the settings of the demo
+    const int fan_count = 256;
+    const float fan_angle_tolerance = 0.25f * DEG2RAD;
+    const int fan_max_rays = (int)ceilf(2.0f * PI / fan_angle_tolerance) + 32;
+    FanRay* fan_rays = heapAlloc(sizeof (FanRay) * fan_max_rays);
+    long long fan_rays_total = 0;
+    snprintf(name, sizeof name, "%s_adaptive_fan", map_name);
+    start = getTimeSeconds();
+    for (int i = 0; i < fan_count; i++) {
+        int fan_rays_cast;
+        castAdaptiveFan(
+            origins[i],
+            map,
+            map_rows,
+            map_cols,
+            tile_size,
+            agent_range,
+            32,
+            fan_angle_tolerance,
+            tile_size,
+            fan_rays,
+            fan_max_rays,
+            &fan_rays_cast
         );
-        DrawText(
-            "[right click] to remove tile",
-            tooltip_x,
-            5 + 3 * font_size + 3 * margin,
-            font_size,
-            WHITE
+        fan_rays_total += fan_rays_cast;
+    }
+    printBenchResult(name, "fans", fan_count, getTimeSeconds() - start, is_first);
+    snprintf(name, sizeof name, "%s_adaptive_fan_rays", map_name);
+    printBenchCount(name, "rays", fan_rays_total, is_first);
+    heapFree(fan_rays);
+
+    // the nearest wall inside a 90 degree view cone
+    int wedge_found_count = 0;
+    snprintf(name, sizeof name, "%s_wedge", map_name);
+    start = getTimeSeconds();
+    for (int i = 0; i < ray_count; i++) {
+        RayHit nearest;
+        Vector2 nearest_pos;
+        wedge_found_count += queryWedge(
+            origins[i],
+            directions[i],
+            45.0f * DEG2RAD,
+            16.0f * tile_size,
+            map,
+            map_rows,
+            map_cols,
+            tile_size,
+            LAYER_VISION,
+            &nearest,
+            &nearest_pos
+        );
+    }
+    printBenchResult(name, "queries", ray_count, getTimeSeconds() - start, is_first);
+    snprintf(name, sizeof name, "%s_wedge_found", map_name);
+    printBenchCount(name, "queries", wedge_found_count, is_first);
+
+    // targets at up to 32 cells from the observer in a random direction, so some are
+    // outside the cone and the rest need their rays
+    int visible_count = 0;
+    snprintf(name, sizeof name, "%s_target_visible", map_name);
+    start = getTimeSeconds();
+    for (int i = 0; i < ray_count; i++) {
+        const Vector2 target_pos = Vector2Add(
+            origins[i],
+            Vector2Scale(directions[(i + 1) % ray_count], (float)(i % 32 + 1) * tile_size)
+        );
+        visible_count += isTargetVisible(
+            origins[i],
+            directions[i],
+            60.0f * DEG2RAD,
+            agent_range,
+            target_pos,
+            0.4f * tile_size,
+            map,
+            map_rows,
+            map_cols,
+            tile_size,
+            LAYER_VISION
+        );
+    }
+    printBenchResult(name, "queries", ray_count, getTimeSeconds() - start, is_first);
+    snprintf(name, sizeof name, "%s_target_visible_count", map_name);
+    printBenchCount(name, "queries", visible_count, is_first);
+
+    heapFree(distances);
+    heapFree(directions);
+    heapFree(origins);
+}
+
+// convertImageRows pixel by pixel, for the benchmarks, without the palette and only for
+// an image of the same size as the map
+void convertImageRowsScalar(void* ctx, int begin, int end) {
+    const ImageConversion* conversion = ctx;
+    const int threshold = conversion->rule->threshold;
+    for (int y = begin; y < end; y++) {
+        const uint8_t* pixels = (const uint8_t*)conversion->image->data + (size_t)y * (size_t)conversion->map_cols * 4;
+        for (int x = 0; x < conversion->map_cols; x++) {
+            conversion->map[y][x] = isWallPixel(&pixels[(size_t)x * 4], threshold) ? CELL_SOLID : CELL_OPEN;
+        }
+    }
+}
+
+// a ChunkLoader for the benchmarks, open chunks with a few pillars that only depend on the
+// chunk coordinates
+void loadPillarChunk(void* user, int chunk_x, int chunk_y, int chunk_size, int* cells) {
+    (void)user;
+    memset(cells, 0, sizeof (int) * (size_t)chunk_size * (size_t)chunk_size);
+    uint32_t rng = ((uint32_t)chunk_x * 73856093u) ^ ((uint32_t)chunk_y * 19349663u) ^ 0x9e3779b9u;
+    if (rng == 0) rng = 1;
+    for (int i = 0; i < 4; i++) {
+        const int x = (int)(nextRandom(&rng) % (uint32_t)chunk_size);
+        const int y = (int)(nextRandom(&rng) % (uint32_t)chunk_size);
+        cells[y * chunk_size + x] = CELL_SOLID;
+    }
+}
+
+// runs the traversal benchmarks without opening a window and prints the results as
+// JSON to stdout
+int runBenchmarks(bool has_huge_corpus) {
+    uint32_t rng = 0x2545f491u;
+    bool is_first = true;
+
+    printf("{\n  \"benchmarks\": [");
+
+    // random rays from many agents spread over a large, sparsely filled map
+    {
+        const int map_rows = 2048;
+        const int map_cols = 2048;
+        const float tile_size = 20.0f;
+        const float max_distance = 2000.0f * tile_size;
+        const int ray_count = 1 << 18;
+
+        int** map = createMap(map_rows, map_cols);
+        for (int i = 0; i < map_rows; i++) {
+            for (int j = 0; j < map_cols; j++) {
+                map[i][j] = (nextRandomFloat(&rng) < 0.002f) ? CELL_SOLID : CELL_OPEN;
+            }
+        }
+
+        Vector2* origins = heapAlloc(sizeof (Vector2) * ray_count);
+        Vector2* directions = heapAlloc(sizeof (Vector2) * ray_count);
+        float* distances = heapAlloc(sizeof (float) * ray_count);
+        for (int i = 0; i < ray_count; i++) {
+            const float angle = 2.0f * PI * nextRandomFloat(&rng);
+            origins[i] = (Vector2){
+                nextRandomFloat(&rng) * (float)map_cols * tile_size,
+                nextRandomFloat(&rng) * (float)map_rows * tile_size,
+            };
+            directions[i] = (Vector2){ cosf(angle), sinf(angle) };
+        }
+
+        RayBatchScratch scratch = createRayBatchScratch(ray_count);
+
+        // both are run once untimed first, so whichever runs first doesn't pay for faulting
+        // in the map, the rays and the scratch buffers or for a cold cache
+        double start;
+        for (int run = 0; run < 2; run++) {
+            start = getTimeSeconds();
+            castRayBatch(
+                origins,
+                directions,
+                ray_count,
+                map,
+                map_rows,
+                map_cols,
+                tile_size,
+                max_distance,
+                distances
+            );
+            if (run == 1) {
+                printBenchResult("batch_random_unsorted", "rays", ray_count, getTimeSeconds() - start, &is_first);
+            }
+
+            start = getTimeSeconds();
+            castRayBatchSorted(
+                origins,
+                directions,
+                ray_count,
+                map,
+                map_rows,
+                map_cols,
+                tile_size,
+                max_distance,
+                &scratch,
+                distances
+            );
+            if (run == 1) {
+                printBenchResult("batch_random_sorted", "rays", ray_count, getTimeSeconds() - start, &is_first);
+            }
+        }
+
+        // jumping across empty squares found with the summed-area table
+        SummedAreaTable sat = createSummedAreaTable(map, map_rows, map_cols, 32);
+        start = getTimeSeconds();
+        for (int i = 0; i < ray_count; i++) {
+            distances[i] = castRayDDASkip(
+                origins[i],
+                directions[i],
+                map,
+                map_rows,
+                map_cols,
+                tile_size,
+                max_distance,
+                &sat,
+                LAYER_ALL
+            ).distance;
+        }
+        printBenchResult("batch_random_sat_skip", "rays", ray_count, getTimeSeconds() - start, &is_first);
+
+        // painting single cells with the table kept up to date through the editor
+        {
+            const int edit_count = 4096;
+
+            MapEditor editor = createMapEditor(map, map_rows, map_cols);
+            addMapEditListener(&editor, onMapEditSummedArea, &sat);
+            start = getTimeSeconds();
+            for (int i = 0; i < edit_count; i++) {
+                const int x = (int)(nextRandom(&rng) % (uint32_t)map_cols);
+                const int y = (int)(nextRandom(&rng) % (uint32_t)map_rows);
+                editMapCell(&editor, x, y, (map[y][x] == CELL_OPEN) ? CELL_SOLID : CELL_OPEN);
+                flushMapEdits(&editor);
+            }
+            printBenchResult("sat_paint_2048", "edits", edit_count, getTimeSeconds() - start, &is_first);
+        }
+        destroySummedAreaTable(&sat);
+
+        destroyRayBatchScratch(&scratch);
+        heapFree(distances);
+        heapFree(directions);
+        heapFree(origins);
+
+        // full distance field build and single cell updates on the same map
+        start = getTimeSeconds();
+        DistanceField df = createDistanceField(map, map_rows, map_cols);
+        printBenchResult(
+            "distance_field_build",
+            "cells",
+            (long long)map_rows * map_cols,
+            getTimeSeconds() - start,
+            &is_first
+        );
+
+        const int edit_count = 1000;
+        start = getTimeSeconds();
+        for (int i = 0; i < edit_count; i++) {
+            const int x = (int)(nextRandom(&rng) % (uint32_t)map_cols);
+            const int y = (int)(nextRandom(&rng) % (uint32_t)map_rows);
+            map[y][x] = (map[y][x] == CELL_OPEN) ? CELL_SOLID : CELL_OPEN;
+            updateDistanceField(&df, map, x, y);
+        }
+        printBenchResult("distance_field_update", "edits", edit_count, getTimeSeconds() - start, &is_first);
+
+        destroyDistanceField(&df);
+
+        // brush strokes and cleared squares logged as deltas and replayed on a copy
+        int** replica = createMap(map_rows, map_cols);
+        for (int i = 0; i < map_rows; i++) memcpy(replica[i], map[i], sizeof (int) * map_cols);
+
+        MapDeltaLog delta_log = createMapDeltaLog();
+        MapEditor editor = createMapEditor(map, map_rows, map_cols);
+        addMapEditListener(&editor, onMapEditDeltaLog, &delta_log);
+
+        const int frame_count = 1000;
+        for (int i = 0; i < frame_count; i++) {
+            const int x = (int)(nextRandom(&rng) % (uint32_t)map_cols);
+            const int y = (int)(nextRandom(&rng) % (uint32_t)map_rows);
+            if (i % 10 == 0) {
+                editMapRect(&editor, x, y, x + 63, y + 63, 0);
+            } else {
+                for (int j = 0; j < 16; j++) editMapCell(&editor, x + j, y, 1);
+            }
+            flushMapEdits(&editor);
+        }
+
+        MapDeltaReader reader = createMapDeltaReader();
+        start = getTimeSeconds();
+        applyMapDeltas(&reader, replica, map_rows, map_cols, delta_log.bytes, delta_log.size);
+        printBenchResult("delta_log_apply", "runs", reader.applied_runs, getTimeSeconds() - start, &is_first);
+        printBenchCount("delta_log_encoded", "bytes", (long long)delta_log.size, &is_first);
+        printBenchMemory("delta_log_memory", getMapDeltaLogBytes(&delta_log), &is_first);
+
+        for (int i = 0; i < map_rows; i++) {
+            if (memcmp(replica[i], map[i], sizeof (int) * map_cols) != 0) {
+                fprintf(stderr, "delta log replica differs from the map in row %d\n", i);
+                break;
+            }
+        }
+
+        destroyMapDeltaReader(&reader);
+        destroyMapDeltaLog(&delta_log);
+        destroyMap(replica, map_rows);
+        destroyMap(map, map_rows);
+    }
+
+    // large open rooms, where jumping across empty space has the best chance to pay off
+    // NOTE: on this map the skip and plain DDA trade places from run to run, see the
+    //       timings rather than expecting a fixed speedup
+    {
+        const int map_rows = 2048;
+        const int map_cols = 2048;
+        const int room_size = 512;
+        const int door_size = 8;
+
+        int** map = createMap(map_rows, map_cols);
+        for (int i = 0; i < map_rows; i++) {
+            for (int j = 0; j < map_cols; j++) {
+                const bool is_wall = i % room_size == 0 || j % room_size == 0;
+                const bool is_door =
+                    (i % room_size) / door_size == room_size / door_size / 2 ||
+                    (j % room_size) / door_size == room_size / door_size / 2;
+                map[i][j] = (is_wall && !is_door) ? CELL_SOLID : CELL_OPEN;
+            }
+        }
+
+        benchTraversals("rooms", map, map_rows, map_cols, &rng, &is_first);
+        destroyMap(map, map_rows);
+    }
+
+    // large solid blobs with open space in between
+    {
+        const int map_rows = 2048;
+        const int map_cols = 2048;
+        const int blob_count = 200;
+
+        int** map = createMap(map_rows, map_cols);
+        for (int b = 0; b < blob_count; b++) {
+            const int center_x = (int)(nextRandom(&rng) % (uint32_t)map_cols);
+            const int center_y = (int)(nextRandom(&rng) % (uint32_t)map_rows);
+            const int radius = 16 + (int)(nextRandom(&rng) % 80);
+            for (int i = center_y - radius; i <= center_y + radius; i++) {
+                for (int j = center_x - radius; j <= center_x + radius; j++) {
+                    if (i < 0 || i >= map_rows || j < 0 || j >= map_cols) continue;
+                    const int dx = j - center_x;
+                    const int dy = i - center_y;
+                    if (dx * dx + dy * dy <= radius * radius) map[i][j] = CELL_SOLID;
+                }
+            }
+        }
+
+        benchTraversals("blobs", map, map_rows, map_cols, &rng, &is_first);
+        destroyMap(map, map_rows);
+    }
+
+    // every traversal on every generated layout at every size of the corpus, named after
+    // the generator and the size, e.g. caves_2048_dda
+    {
+        const int sizes[] = { 80, 512, 2048, 16384 };
+        const int size_count = has_huge_corpus ? 4 : 3;
+
+        for (int s = 0; s < size_count; s++) {
+            const int size = sizes[s];
+            int** map = createMap(size, size);
+            for (int g = 0; g < MAP_GENERATOR_COUNT; g++) {
+                char name[64];
+                snprintf(name, sizeof name, "%s_%d_generate", map_generators[g].name, size);
+                const double start = getTimeSeconds();
+                map_generators[g].generate(map, size, size, 0x5eed0000u + (uint32_t)g);
+                printBenchResult(name, "cells", (long long)size * size, getTimeSeconds() - start, &is_first);
+
+                snprintf(name, sizeof name, "%s_%d", map_generators[g].name, size);
+                benchTraversals(name, map, size, size, &rng, &is_first);
+            }
+            destroyMap(map, size);
+        }
+    }
+
+    // steps of the cave automaton on packed rows, on a random fill of a large map
+    {
+        const int size = 8192;
+        const int step_count = 16;
+
+        BitGrid grid = createBitGrid(size, size);
+        BitGrid next = createBitGrid(size, size);
+        for (size_t i = 0; i < (size_t)size * (size_t)grid.words_per_row; i++) {
+            grid.bits[i] = ((uint64_t)nextRandom(&rng) << 32) | nextRandom(&rng);
+        }
+
+        const double start = getTimeSeconds();
+        for (int step = 0; step < step_count; step++) {
+            stepCaveAutomaton(&grid, &next);
+            const BitGrid swap = grid;
+            grid = next;
+            next = swap;
+        }
+        printBenchResult("caves_step_8192", "cells", (long long)step_count * size * size, getTimeSeconds() - start, &is_first);
+
+        destroyBitGrid(&next);
+        destroyBitGrid(&grid);
+    }
+
+    // conversion of a large image, into packed rows only on a single thread, into a map with
+    // convertImageToMap, and into a map pixel by pixel on the same parallelFor bands, so
+    // the last two only differ in the conversion
+    {
+        const int size = 8192;
+        const MapImageRule rule = { .threshold = 128 };
+
+        Color* pixels = heapAlloc(sizeof (Color) * (size_t)size * (size_t)size);
+        for (size_t i = 0; i < (size_t)size * (size_t)size; i++) {
+            const uint8_t grey = (uint8_t)nextRandom(&rng);
+            pixels[i] = (Color){ grey, grey, grey, 255 };
+        }
+        const Image image = {
+            .data = pixels,
+            .width = size,
+            .height = size,
+            .mipmaps = 1,
+            .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+        };
+        // the map is touched once up front, so none of the runs below pays for its page faults
+        int** map = createMap(size, size);
+        fillMapRect(map, 0, 0, size - 1, size - 1, CELL_SOLID);
+
+        BitGrid grid = createBitGrid(size, size);
+        double start = getTimeSeconds();
+        for (int i = 0; i < size; i++) {
+            const uint8_t* row = (const uint8_t*)&pixels[(size_t)i * size];
+            for (int j = 0; j < grid.words_per_row; j++) {
+                grid.bits[(size_t)i * grid.words_per_row + j] = packWallPixels(&row[j * 64 * 4], 64, rule.threshold);
+            }
+        }
+        printBenchResult("image_pack_8192", "pixels", (long long)size * size, getTimeSeconds() - start, &is_first);
+        destroyBitGrid(&grid);
+
+        start = getTimeSeconds();
+        convertImageToMap(&image, map, size, size, &rule);
+        printBenchResult("image_import_8192", "pixels", (long long)size * size, getTimeSeconds() - start, &is_first);
+
+        ImageConversion conversion = { .image = &image, .rule = &rule, .map = map, .map_cols = size };
+        start = getTimeSeconds();
+        parallelFor(size, 64, convertImageRowsScalar, &conversion);
+        printBenchResult("image_import_scalar_8192", "pixels", (long long)size * size, getTimeSeconds() - start, &is_first);
+
+        destroyMap(map, size);
+        heapFree(pixels);
+    }
+
+    // building interiors with thin walls on the cell edges and doors that are toggled
+    // between two batches
+    {
+        const int map_rows = 2048;
+        const int map_cols = 2048;
+        const int room_size = 16;
+        const float tile_size = 20.0f;
+        const float max_distance = 2000.0f * tile_size;
+        const int ray_count = 1 << 16;
+
+        EdgeMap edges = createEdgeMap(map_rows, map_cols);
+        for (int i = 0; i <= map_rows; i++) {
+            for (int j = 0; j <= map_cols; j++) {
+                if (i % room_size == 0) setNorthEdge(&edges, j, i, true);
+                if (j % room_size == 0) setWestEdge(&edges, j, i, true);
+            }
+        }
+
+        Vector2* origins = heapAlloc(sizeof (Vector2) * ray_count);
+        Vector2* directions = heapAlloc(sizeof (Vector2) * ray_count);
+        float* distances = heapAlloc(sizeof (float) * ray_count);
+        for (int i = 0; i < ray_count; i++) {
+            const float angle = 2.0f * PI * nextRandomFloat(&rng);
+            origins[i] = (Vector2){
+                nextRandomFloat(&rng) * (float)map_cols * tile_size,
+                nextRandomFloat(&rng) * (float)map_rows * tile_size,
+            };
+            directions[i] = (Vector2){ cosf(angle), sinf(angle) };
+        }
+
+        double seconds = 0.0;
+        for (int pass = 0; pass < 2; pass++) {
+            // one door in the middle of the north and west wall of every room
+            for (int i = room_size / 2; i < map_rows; i += room_size) {
+                for (int j = room_size / 2; j < map_cols; j += room_size) {
+                    toggleNorthEdge(&edges, j, i - room_size / 2);
+                    toggleWestEdge(&edges, j - room_size / 2, i);
+                }
+            }
+
+            const double start = getTimeSeconds();
+            for (int i = 0; i < ray_count; i++) {
+                distances[i] = castRayEdges(origins[i], directions[i], &edges, tile_size, max_distance).distance;
+            }
+            seconds += getTimeSeconds() - start;
+        }
+        printBenchResult("edges_rooms", "rays", 2 * ray_count, seconds, &is_first);
+        printBenchMemory(
+            "edges_rooms_memory",
+            2 * sizeof (uint64_t) * (size_t)(map_rows + 1) * (size_t)edges.words_per_row,
+            &is_first
         );
-        DrawText(
-            "[c] to clear tiles",
-            tooltip_x,
-            5 + 4 * font_size + 4 * margin,
-            font_size,
-            WHITE
+
+        heapFree(distances);
+        heapFree(directions);
+        heapFree(origins);
+        destroyEdgeMap(&edges);
+    }
+
+    // one map split into small tiles that are linked along their borders by portals,
+    // against the same map in one piece
+    {
+        const int tiles_per_side = 8;
+        const int tile_cells = 64;
+        const int map_size = tiles_per_side * tile_cells;
+        const float tile_size = 20.0f;
+        const float max_distance = 2000.0f * tile_size;
+        const int ray_count = 1 << 16;
+
+        int** map = createMap(map_size, map_size);
+        for (int i = 0; i < map_size; i++) {
+            for (int j = 0; j < map_size; j++) map[i][j] = (nextRandomFloat(&rng) < 0.002f) ? CELL_SOLID : CELL_OPEN;
+        }
+
+        const int tile_count = tiles_per_side * tiles_per_side;
+        int*** tiles = heapAlloc(sizeof (int**) * tile_count);
+        PortalWorld world = createPortalWorld(tile_count);
+        for (int t = 0; t < tile_count; t++) {
+            const int x0 = (t % tiles_per_side) * tile_cells;
+            const int y0 = (t / tiles_per_side) * tile_cells;
+            tiles[t] = createMap(tile_cells, tile_cells);
+            for (int i = 0; i < tile_cells; i++) {
+                memcpy(tiles[t][i], &map[y0 + i][x0], sizeof (int) * tile_cells);
+            }
+            setPortalWorldMap(&world, t, tiles[t], tile_cells, tile_cells);
+        }
+        for (int t = 0; t < tile_count; t++) {
+            const int last = tile_cells - 1;
+            for (int i = 0; i < tile_cells; i++) {
+                if (t % tiles_per_side + 1 < tiles_per_side) {
+                    linkPortals(&world, t, last, i, FACE_EAST, t + 1, 0, i, FACE_WEST);
+                }
+                if (t / tiles_per_side + 1 < tiles_per_side) {
+                    linkPortals(&world, t, i, last, FACE_SOUTH, t + tiles_per_side, i, 0, FACE_NORTH);
+                }
+            }
+        }
+
+        Vector2* origins = heapAlloc(sizeof (Vector2) * ray_count);
+        Vector2* directions = heapAlloc(sizeof (Vector2) * ray_count);
+        float* distances = heapAlloc(sizeof (float) * ray_count);
+        for (int i = 0; i < ray_count; i++) {
+            const float angle = 2.0f * PI * nextRandomFloat(&rng);
+            origins[i] = (Vector2){
+                nextRandomFloat(&rng) * (float)map_size * tile_size,
+                nextRandomFloat(&rng) * (float)map_size * tile_size,
+            };
+            directions[i] = (Vector2){ cosf(angle), sinf(angle) };
+        }
+
+        double start = getTimeSeconds();
+        castRayBatch(origins, directions, ray_count, map, map_size, map_size, tile_size, max_distance, distances);
+        printBenchResult("portal_single", "rays", ray_count, getTimeSeconds() - start, &is_first);
+
+        start = getTimeSeconds();
+        for (int i = 0; i < ray_count; i++) {
+            const int cell_x = (int)(origins[i].x / tile_size);
+            const int cell_y = (int)(origins[i].y / tile_size);
+            const int tile_x = cell_x / tile_cells;
+            const int tile_y = cell_y / tile_cells;
+            const Vector2 local = {
+                origins[i].x - (float)(tile_x * tile_cells) * tile_size,
+                origins[i].y - (float)(tile_y * tile_cells) * tile_size,
+            };
+            distances[i] = castRayPortals(
+                &world,
+                tile_y * tiles_per_side + tile_x,
+                local,
+                directions[i],
+                tile_size,
+                max_distance,
+                4 * tiles_per_side,
+                LAYER_ALL
+            ).hit.distance;
+        }
+        printBenchResult("portal_tiles", "rays", ray_count, getTimeSeconds() - start, &is_first);
+
+        heapFree(distances);
+        heapFree(directions);
+        heapFree(origins);
+        destroyPortalWorld(&world);
+        for (int t = 0; t < tile_count; t++) destroyMap(tiles[t], tile_cells);
+        heapFree(tiles);
+        destroyMap(map, map_size);
+    }
+
+    // line of sight queries in a building with rooms on every floor and stairwells that
+    // connect the floors
+    {
+        const int floors = 8;
+        const int map_rows = 256;
+        const int map_cols = 256;
+        const int room_size = 16;
+        const int shaft_spacing = 64;
+        const float tile_size = 20.0f;
+        const float floor_height = 60.0f;
+        const int query_count = 1 << 16;
+
+        LayeredMap layers = createLayeredMap(floors, map_rows, map_cols);
+        for (int f = 0; f < floors; f++) {
+            for (int i = 0; i < map_rows; i++) {
+                for (int j = 0; j < map_cols; j++) {
+                    const bool is_wall = i % room_size == 0 || j % room_size == 0;
+                    const bool is_door = i % room_size == room_size / 2 || j % room_size == room_size / 2;
+                    if (is_wall && !is_door) setLayerWall(&layers, f, j, i, true);
+
+                    const bool is_shaft =
+                        f + 1 < floors &&
+                        i % shaft_spacing >= 4 && i % shaft_spacing < 8 &&
+                        j % shaft_spacing >= 4 && j % shaft_spacing < 8;
+                    if (is_shaft) setLayerOpening(&layers, f, j, i, true);
+                }
+            }
+        }
+
+        Vector3* points = heapAlloc(sizeof (Vector3) * 2 * query_count);
+        for (int i = 0; i < 2 * query_count; i++) {
+            points[i] = (Vector3){
+                nextRandomFloat(&rng) * (float)map_cols * tile_size,
+                nextRandomFloat(&rng) * (float)map_rows * tile_size,
+                nextRandomFloat(&rng) * (float)floors * floor_height,
+            };
+        }
+
+        int visible_count = 0;
+        const double start = getTimeSeconds();
+        for (int i = 0; i < query_count; i++) {
+            visible_count += hasLayeredLineOfSight(
+                &layers,
+                points[2 * i],
+                points[2 * i + 1],
+                tile_size,
+                floor_height
+            );
+        }
+        printBenchResult("layered_line_of_sight", "queries", query_count, getTimeSeconds() - start, &is_first);
+        printBenchCount("layered_line_of_sight_visible", "queries", visible_count, &is_first);
+        printBenchMemory("layered_memory", getLayeredMapBytes(&layers), &is_first);
+
+        heapFree(points);
+        destroyLayeredMap(&layers);
+    }
+
+    // a sparse hex map with as many cells and walls as the sparse square map above
+    {
+        const int map_rows = 2048;
+        const int map_cols = 2048;
+        const float wall_density = 0.002f;
+        const float hex_size = 10.0f;
+        const float max_distance = 2000.0f * hex_size;
+        const int ray_count = 1 << 16;
+
+        HexMap hex = createHexMap(map_rows, map_cols);
+        for (int r = 0; r < map_rows; r++) {
+            for (int col = 0; col < map_cols; col++) {
+                if (nextRandomFloat(&rng) < wall_density) setHexWall(&hex, col - (r >> 1), r, true);
+            }
+        }
+
+        Vector2* origins = heapAlloc(sizeof (Vector2) * ray_count);
+        Vector2* directions = heapAlloc(sizeof (Vector2) * ray_count);
+        float* distances = heapAlloc(sizeof (float) * ray_count);
+        for (int i = 0; i < ray_count; i++) {
+            const float angle = 2.0f * PI * nextRandomFloat(&rng);
+            const int r = (int)(nextRandom(&rng) % (uint32_t)map_rows);
+            const int col = (int)(nextRandom(&rng) % (uint32_t)map_cols);
+            origins[i] = hexToPixel(col - (r >> 1), r, hex_size);
+            directions[i] = (Vector2){ cosf(angle), sinf(angle) };
+        }
+
+        const double start = getTimeSeconds();
+        castRayHexBatch(origins, directions, ray_count, &hex, hex_size, max_distance, distances);
+        printBenchResult("hex_random", "rays", ray_count, getTimeSeconds() - start, &is_first);
+        printBenchMemory(
+            "hex_random_memory",
+            sizeof (uint64_t) * (size_t)map_rows * (size_t)hex.words_per_row,
+            &is_first
         );
 
-        EndDrawing();
+        heapFree(distances);
+        heapFree(directions);
+        heapFree(origins);
+        destroyHexMap(&hex);
     }
 
-    // uninitialize
-    for (int i = 0; i < map_rows; i++) {
-        free(map[i]);
+    // random rays over a map far larger than the TLB reach of 4 KB pages, with the cells on
+    // normal pages, on huge pages, and on huge pages first touched by pinned workers
+    // large_map_pages says what the huge page runs actually got (see PAGES_NORMAL)
+    {
+        const int map_rows = 8192;
+        const int map_cols = 8192;
+        const float tile_size = 20.0f;
+        const float max_distance = 2000.0f * tile_size;
+        const int ray_count = 1 << 18;
+
+        Vector2* origins = heapAlloc(sizeof (Vector2) * ray_count);
+        Vector2* directions = heapAlloc(sizeof (Vector2) * ray_count);
+        float* distances = heapAlloc(sizeof (float) * ray_count);
+        for (int i = 0; i < ray_count; i++) {
+            const float angle = 2.0f * PI * nextRandomFloat(&rng);
+            origins[i] = (Vector2){
+                nextRandomFloat(&rng) * (float)map_cols * tile_size,
+                nextRandomFloat(&rng) * (float)map_rows * tile_size,
+            };
+            directions[i] = (Vector2){ cosf(angle), sinf(angle) };
+        }
+
+        const char* names[] = { "large_map_normal_pages", "large_map_huge_pages", "large_map_huge_pages_pinned" };
+        const uint32_t map_seed = nextRandom(&rng);
+        for (int run = 0; run < 3; run++) {
+            pin_worker_threads = (run == 2);
+
+            LargeBlock block;
+            int** map = createMapLarge(map_rows, map_cols, run > 0, &block);
+            if (map == NULL) continue;
+            // the same walls in every run
+            uint32_t map_rng = map_seed;
+            for (int i = 0; i < map_rows; i++) {
+                for (int j = 0; j < map_cols; j++) {
+                    map[i][j] = (nextRandomFloat(&map_rng) < 0.002f) ? CELL_SOLID : CELL_OPEN;
+                }
+            }
+
+            const double start = getTimeSeconds();
+            castRayBatchParallel(
+                origins,
+                directions,
+                ray_count,
+                map,
+                map_rows,
+                map_cols,
+                tile_size,
+                max_distance,
+                distances
+            );
+            printBenchResult(names[run], "rays", ray_count, getTimeSeconds() - start, &is_first);
+            if (run == 1) printBenchCount("large_map_pages", "mode", block.pages, &is_first);
+
+            destroyMapLarge(map, &block);
+        }
+        pin_worker_threads = false;
+
+        heapFree(distances);
+        heapFree(directions);
+        heapFree(origins);
     }
-    free(map);
 
-    CloseWindow();
+    // a camera moving through a streamed world, with the chunk buffers from the slab pool
+    // and from the heap, the pool run counts the heap allocations after its first frame
+    {
+        const int chunk_size = 32;
+        const int window = 8;
+        const int frame_count = 20000;
+        const char* names[] = { "chunk_stream_heap", "chunk_stream_pool" };
+
+        ChunkPool pool;
+        initChunkPool(&pool, sizeof (int) * chunk_size * chunk_size, 64);
+        for (int run = 0; run < 2; run++) {
+            ChunkMagazine magazine = createChunkMagazine(&pool);
+            ChunkMagazine* chunks = (run == 1) ? &magazine : NULL;
+            ChunkStream stream = createChunkStream(chunk_size, window, loadPillarChunk, NULL);
+
+            updateChunkStream(&stream, chunks, 0, 0);
+            const long long heap_allocs = getHeapAllocCount();
+            const long long loaded_count = stream.loaded_count;
+            const double start = getTimeSeconds();
+            for (int frame = 1; frame <= frame_count; frame++) {
+                // right one chunk per frame, and up and down in a long zigzag
+                const int center_y = (frame / 64) % 2 == 0 ? frame % 64 : 63 - frame % 64;
+                updateChunkStream(&stream, chunks, frame, center_y);
+            }
+            printBenchResult(
+                names[run],
+                "chunks",
+                stream.loaded_count - loaded_count,
+                getTimeSeconds() - start,
+                &is_first
+            );
+            if (run == 1) {
+                printBenchCount("chunk_stream_pool_heap_allocs", "allocations", getHeapAllocCount() - heap_allocs, &is_first);
+            }
+
+            destroyChunkStream(&stream, chunks);
+            flushChunkMagazine(&magazine);
+        }
+        printBenchMemory("chunk_pool_memory", getChunkPoolBytes(&pool), &is_first);
+        destroyChunkPool(&pool);
+    }
+
+    // the work of a frame with many agents, all scratch data from a frame arena, the heap
+    // allocations are counted once the arena has grown to fit a frame and should be zero
+    {
+        const int map_rows = 80;
+        const int map_cols = 80;
+        const float tile_size = 20.0f;
+        const float max_distance = 1000.0f;
+        const int agent_count = 4096;
+        const int frame_count = 600;
+        const int warmup_count = 2;
+        const float fan_angle_tolerance = 0.25f * DEG2RAD;
+        const int fan_max_rays = (int)ceilf(2.0f * PI / fan_angle_tolerance) + 32;
+
+        int** map = createMap(map_rows, map_cols);
+        for (int i = 0; i < map_rows; i++) {
+            for (int j = 0; j < map_cols; j++) {
+                map[i][j] = (nextRandomFloat(&rng) < 0.05f) ? CELL_SOLID : CELL_OPEN;
+            }
+        }
+
+        Arena arena = createArena(4096);
+        long long heap_allocs = 0;
+        double start = getTimeSeconds();
+        for (int frame = 0; frame < warmup_count + frame_count; frame++) {
+            if (frame == warmup_count) {
+                heap_allocs = getHeapAllocCount();
+                start = getTimeSeconds();
+            }
+            resetArena(&arena);
+
+            Vector2* origins = allocArena(&arena, sizeof (Vector2) * agent_count);
+            Vector2* directions = allocArena(&arena, sizeof (Vector2) * agent_count);
+            float* distances = allocArena(&arena, sizeof (float) * agent_count);
+            for (int i = 0; i < agent_count; i++) {
+                const float angle = 2.0f * PI * nextRandomFloat(&rng);
+                origins[i] = (Vector2){
+                    nextRandomFloat(&rng) * (float)map_cols * tile_size,
+                    nextRandomFloat(&rng) * (float)map_rows * tile_size,
+                };
+                directions[i] = (Vector2){ cosf(angle), sinf(angle) };
+            }
+            RayBatchScratch scratch = allocRayBatchScratch(&arena, agent_count);
+            castRayBatchSorted(
+                origins,
+                directions,
+                agent_count,
+                map,
+                map_rows,
+                map_cols,
+                tile_size,
+                max_distance,
+                &scratch,
+                distances
+            );
+
+            FanRay* fan_rays = allocArena(&arena, sizeof (FanRay) * fan_max_rays);
+            int fan_rays_cast;
+            castAdaptiveFan(
+                origins[0],
+                map,
+                map_rows,
+                map_cols,
+                tile_size,
+                max_distance,
+                32,
+                fan_angle_tolerance,
+                tile_size,
+                fan_rays,
+                fan_max_rays,
+                &fan_rays_cast
+            );
+        }
+        printBenchResult("frame_arena", "frames", frame_count, getTimeSeconds() - start, &is_first);
+        printBenchCount("frame_arena_heap_allocs", "allocations", getHeapAllocCount() - heap_allocs, &is_first);
+        printBenchMemory("frame_arena_peak", arena.peak, &is_first);
+
+        destroyArena(&arena);
+        destroyMap(map, map_rows);
+    }
+
+    // the structures of the demo kept up to date through the editor while walls are painted,
+    // prints what each one takes up and the heap allocations made over all painted frames
+    {
+        const int map_rows = 80;
+        const int map_cols = 80;
+        const int frame_count = 600;
+
+        int** map = createMap(map_rows, map_cols);
+        OccupancyBlocks occ = createOccupancyBlocks(map, map_rows, map_cols, 8);
+        DistanceField distance_field = createDistanceField(map, map_rows, map_cols);
+        QuadTree quad_tree = createQuadTree(map, map_rows, map_cols);
+        TileMesh tile_mesh = createTileMesh(map_rows, map_cols, 16);
+        RayCache fan_cache = createRayCache(720);
+
+        MapEditor editor = createMapEditor(map, map_rows, map_cols);
+        addMapEditListener(&editor, onMapEditOccupancy, &occ);
+        addMapEditListener(&editor, onMapEditDistanceField, &distance_field);
+        addMapEditListener(&editor, onMapEditQuadTree, &quad_tree);
+        addMapEditListener(&editor, onMapEditTileMesh, &tile_mesh);
+
+        const long long heap_allocs = getHeapAllocCount();
+        for (int frame = 0; frame < frame_count; frame++) {
+            // a brush stroke of a few cells per frame
+            for (int i = 0; i < 4; i++) {
+                editMapCell(
+                    &editor,
+                    (int)(nextRandom(&rng) % (uint32_t)map_cols),
+                    (int)(nextRandom(&rng) % (uint32_t)map_rows),
+                    (nextRandomFloat(&rng) < 0.7f) ? CELL_SOLID : CELL_OPEN
+                );
+            }
+            flushMapEdits(&editor);
+            updateTileMesh(&tile_mesh, map);
+        }
+        printBenchCount("demo_edit_heap_allocs", "allocations", getHeapAllocCount() - heap_allocs, &is_first);
+
+        MemoryReport report = { 0 };
+        addMemoryEntry(&report, "map", getMapBytes(map_rows, map_cols));
+        addMemoryEntry(&report, "occupancy", getOccupancyBlocksBytes(&occ));
+        addMemoryEntry(&report, "distance_field", getDistanceFieldBytes(&distance_field));
+        addMemoryEntry(&report, "quadtree", getQuadTreeBytes(&quad_tree));
+        addMemoryEntry(&report, "tile_mesh", getTileMeshBytes(&tile_mesh));
+        addMemoryEntry(&report, "ray_cache", getRayCacheBytes(&fan_cache));
+        addMemoryEntry(&report, "editor", getMapEditorBytes(&editor));
+        // the demo keeps a second map to import images into
+        addMemoryEntry(&report, "import_map", getMapBytes(map_rows, map_cols));
+        char name[64];
+        for (int i = 0; i < report.count; i++) {
+            snprintf(name, sizeof name, "demo_%s_memory", report.names[i]);
+            printBenchMemory(name, report.bytes[i], &is_first);
+        }
+        printBenchMemory("demo_total_memory", report.total_bytes, &is_first);
+
+        destroyRayCache(&fan_cache);
+        destroyTileMesh(&tile_mesh);
+        destroyQuadTree(&quad_tree);
+        destroyDistanceField(&distance_field);
+        destroyOccupancyBlocks(&occ);
+        destroyMap(map, map_rows);
+    }
+
+    // a reload of a large map after a few rooms were changed outside of the demo, once
+    // diffed chunk by chunk with applyMapDiff and once as a full reload that marks the whole
+    // map dirty, both until the derived structures of the demo are up to date again
+    {
+        const int map_rows = 2048;
+        const int map_cols = 2048;
+        const int chunk_size = 16;
+
+        int** map = createMap(map_rows, map_cols);
+        int** next = createMap(map_rows, map_cols);
+        generateCityMap(map, map_rows, map_cols, 0x5eed0100u);
+        for (int i = 0; i < map_rows; i++) memcpy(next[i], map[i], sizeof (int) * (size_t)map_cols);
+        for (int i = 0; i < 8; i++) {
+            const int x = (int)(nextRandom(&rng) % (uint32_t)(map_cols - 24));
+            const int y = (int)(nextRandom(&rng) % (uint32_t)(map_rows - 24));
+            fillMapRect(next, x, y, x + 23, y + 23, CELL_SOLID);
+            fillMapRect(next, x + 1, y + 1, x + 22, y + 22, CELL_OPEN);
+        }
+
+        OccupancyBlocks occ = createOccupancyBlocks(map, map_rows, map_cols, 8);
+        DistanceField distance_field = createDistanceField(map, map_rows, map_cols);
+        QuadTree quad_tree = createQuadTree(map, map_rows, map_cols);
+        TileMesh tile_mesh = createTileMesh(map_rows, map_cols, chunk_size);
+        updateTileMesh(&tile_mesh, map);
+
+        MapEditor editor = createMapEditor(map, map_rows, map_cols);
+        addMapEditListener(&editor, onMapEditOccupancy, &occ);
+        addMapEditListener(&editor, onMapEditDistanceField, &distance_field);
+        addMapEditListener(&editor, onMapEditQuadTree, &quad_tree);
+        addMapEditListener(&editor, onMapEditTileMesh, &tile_mesh);
+
+        // a copy of the map before the change, to go back to between the two runs
+        int** base = createMap(map_rows, map_cols);
+        for (int i = 0; i < map_rows; i++) memcpy(base[i], map[i], sizeof (int) * (size_t)map_cols);
+
+        double start = getTimeSeconds();
+        const int changed_chunks = applyMapDiff(&editor, next, chunk_size);
+        flushMapEdits(&editor);
+        updateTileMesh(&tile_mesh, map);
+        printBenchResult("map_reload_diff_2048", "cells", (long long)map_rows * map_cols, getTimeSeconds() - start, &is_first);
+        printBenchCount("map_reload_diff_chunks", "chunks", changed_chunks, &is_first);
+
+        applyMapDiff(&editor, base, chunk_size);
+        flushMapEdits(&editor);
+        updateTileMesh(&tile_mesh, map);
+
+        start = getTimeSeconds();
+        for (int i = 0; i < map_rows; i++) memcpy(map[i], next[i], sizeof (int) * (size_t)map_cols);
+        markMapDirty(&editor, (MapRect){ .x0 = 0, .y0 = 0, .x1 = map_cols - 1, .y1 = map_rows - 1 });
+        flushMapEdits(&editor);
+        updateTileMesh(&tile_mesh, map);
+        printBenchResult("map_reload_full_2048", "cells", (long long)map_rows * map_cols, getTimeSeconds() - start, &is_first);
+
+        destroyTileMesh(&tile_mesh);
+        destroyQuadTree(&quad_tree);
+        destroyDistanceField(&distance_field);
+        destroyOccupancyBlocks(&occ);
+        destroyMap(base, map_rows);
+        destroyMap(next, map_rows);
+        destroyMap(map, map_rows);
+    }
+
+    printf("\n  ]\n}\n");
+
     return EXIT_SUCCESS;
 }
 
-void drawDottedLine(Vector2 start_pos, Vector2 end_pos, Color color) {
-    const float len = 4.0f;
-    const Vector2 dir = Vector2Normalize(Vector2Subtract(end_pos, start_pos));
-    const float full_distance = Vector2Distance(start_pos, end_pos);
-    const int steps = (int)(full_distance / (len * 2.0f));
+// prints the outcome of one self test and passes it on
+bool reportSelfTest(const char* name, bool is_ok) {
+    printf("%-32s %s\n", name, is_ok ? "ok" : "FAILED");
+    return is_ok;
+}
 
-    for (int i = 0; i < steps; i++) {
-        start_pos = Vector2Add(start_pos, Vector2Scale(dir, len));
-        end_pos = Vector2Add(start_pos, Vector2Scale(dir, len));
-        if (i % 2 == 0) {
-            DrawLineV(start_pos, end_pos, color);
+// returns the cell at x/y of a bit grid, cells outside the grid are walls like in getCaveWord
+bool isCaveWall(const BitGrid* grid, int x, int y) {
+    if (x < 0 || x >= grid->cols || y < 0 || y >= grid->rows) return true;
+    return (grid->bits[(size_t)y * grid->words_per_row + (x >> 6)] >> (x & 63)) & 1;
+}
+
+// what one thread of the magazine stress test works with
+typedef struct MagazineStress {
+    ChunkPool* pool;
+    int thread_index;
+    int round_count;
+    bool is_ok;
+} MagazineStress;
+
+// allocates and frees blocks in a random order through a magazine of its own, every held
+// block is stamped with its owner, so a block handed out twice is caught on free
+void* runMagazineStress(void* arg) {
+    MagazineStress* stress = arg;
+    ChunkMagazine magazine = createChunkMagazine(stress->pool);
+    uint32_t rng = 0x5eed5eedu + (uint32_t)stress->thread_index;
+
+    void* held[256];
+    int held_count = 0;
+    for (int round = 0; round < stress->round_count; round++) {
+        const bool is_alloc = held_count == 0 || (held_count < 256 && (nextRandom(&rng) & 1));
+        if (is_alloc) {
+            int* block = allocChunk(&magazine);
+            if (block == NULL) {
+                stress->is_ok = false;
+                break;
+            }
+            block[0] = stress->thread_index;
+            block[1] = round;
+            held[held_count++] = block;
+        } else {
+            const int k = (int)(nextRandom(&rng) % (uint32_t)held_count);
+            int* block = held[k];
+            if (block[0] != stress->thread_index) stress->is_ok = false;
+            held[k] = held[--held_count];
+            freeChunk(&magazine, block);
+        }
+    }
+    while (held_count > 0) freeChunk(&magazine, held[--held_count]);
+    flushChunkMagazine(&magazine);
+    return NULL;
+}
+
+// checks what the benchmarks only print: the packed and the scalar paths agree, and the
+// pooled and arena paths stop allocating once they are warm
+// returns EXIT_FAILURE if any check fails
+int runSelfTests(void) {
+    uint32_t rng = 0x5e1f7e57u;
+    bool is_ok = true;
+
+    // the cave automaton on packed rows against the rule applied cell by cell, on sizes
+    // around the word boundaries
+    {
+        const int sizes[][2] = { { 1, 1 }, { 3, 70 }, { 65, 63 }, { 64, 128 }, { 130, 200 } };
+        const int size_count = (int)(sizeof sizes / sizeof sizes[0]);
+
+        bool is_equal = true;
+        for (int s = 0; s < size_count; s++) {
+            BitGrid grid = createBitGrid(sizes[s][0], sizes[s][1]);
+            BitGrid next = createBitGrid(sizes[s][0], sizes[s][1]);
+            for (int y = 0; y < grid.rows; y++) {
+                for (int x = 0; x < grid.cols; x++) {
+                    if (nextRandomFloat(&rng) < 0.45f) grid.bits[(size_t)y * grid.words_per_row + (x >> 6)] |= (uint64_t)1 << (x & 63);
+                }
+            }
+
+            stepCaveAutomaton(&grid, &next);
+            for (int y = 0; y < grid.rows; y++) {
+                for (int x = 0; x < grid.cols; x++) {
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            if ((dx != 0 || dy != 0) && isCaveWall(&grid, x + dx, y + dy)) count++;
+                        }
+                    }
+                    const bool is_wall = count >= 5 || (count == 4 && isCaveWall(&grid, x, y));
+                    if (is_wall != isCaveWall(&next, x, y)) is_equal = false;
+                }
+                // the bits past the last column have to stay clear
+                const int tail = grid.cols - (grid.words_per_row - 1) * 64;
+                const uint64_t last = next.bits[(size_t)y * next.words_per_row + next.words_per_row - 1];
+                if (tail < 64 && (last >> tail) != 0) is_equal = false;
+            }
+
+            destroyBitGrid(&next);
+            destroyBitGrid(&grid);
+        }
+        is_ok &= reportSelfTest("cave_step_packed", is_equal);
+    }
+
+    // packWallPixels against isWallPixel, for every pixel count and the extreme thresholds
+    {
+        uint8_t pixels[64 * 4];
+        bool is_equal = true;
+        for (int round = 0; round < 4096; round++) {
+            for (int k = 0; k < 64 * 4; k++) pixels[k] = (uint8_t)nextRandom(&rng);
+            const int count = 1 + round % 64;
+            int threshold = (int)(nextRandom(&rng) % 257);
+            if (round % 3 == 0) threshold = (round % 2 == 0) ? 0 : 256;
+
+            const uint64_t word = packWallPixels(pixels, count, threshold);
+            for (int k = 0; k < 64; k++) {
+                const bool is_wall = k < count && isWallPixel(&pixels[k * 4], threshold);
+                if (is_wall != (bool)((word >> k) & 1)) is_equal = false;
+            }
+        }
+        is_ok &= reportSelfTest("image_pack", is_equal);
+    }
+
+    // cached rays against castRayDDAHit on a map with walls and slopes, with slopes painted
+    // between the frames and the origins moving a little, like in the demo
+    {
+        const int map_rows = 200;
+        const int map_cols = 200;
+        const float tile_size = 20.0f;
+        const float max_distance = 4000.0f;
+        const int ray_count = 20000;
+        const int frame_count = 4;
+        const int slopes[] = { CELL_SLOPE_NW, CELL_SLOPE_NE, CELL_SLOPE_SW, CELL_SLOPE_SE };
+
+        int** map = createMap(map_rows, map_cols);
+        for (int i = 0; i < map_rows; i++) {
+            for (int j = 0; j < map_cols; j++) {
+                const float r = nextRandomFloat(&rng);
+                if (r < 0.01f) {
+                    map[i][j] = CELL_SOLID;
+                } else if (r < 0.02f) {
+                    map[i][j] = slopes[nextRandom(&rng) % 4];
+                }
+            }
+        }
+
+        Vector2* origins = heapAlloc(sizeof (Vector2) * ray_count);
+        Vector2* directions = heapAlloc(sizeof (Vector2) * ray_count);
+        for (int i = 0; i < ray_count; i++) {
+            const float angle = 2.0f * PI * nextRandomFloat(&rng);
+            origins[i] = (Vector2){
+                nextRandomFloat(&rng) * (float)map_cols * tile_size,
+                nextRandomFloat(&rng) * (float)map_rows * tile_size,
+            };
+            directions[i] = (Vector2){ cosf(angle), sinf(angle) };
+        }
+
+        RayCache cache = createRayCache(ray_count);
+        bool is_equal = true;
+        for (int frame = 0; frame < frame_count; frame++) {
+            OccupancyBlocks occ = createOccupancyBlocks(map, map_rows, map_cols, 8);
+            const Vector2 offset = { 0.3f * (float)frame, 0.2f * (float)frame };
+            for (int i = 0; i < ray_count; i++) {
+                const Vector2 origin = Vector2Add(origins[i], offset);
+                const RayHit cached = castRayCached(
+                    &cache,
+                    i,
+                    origin,
+                    directions[i],
+                    map,
+                    map_rows,
+                    map_cols,
+                    tile_size,
+                    max_distance,
+                    &occ
+                );
+                const RayHit hit = castRayDDAHit(origin, directions[i], map, map_rows, map_cols, tile_size, max_distance, LAYER_ALL);
+                if (fabsf(cached.distance - hit.distance) > 0.01f) is_equal = false;
+            }
+            destroyOccupancyBlocks(&occ);
+
+            for (int k = 0; k < 400; k++) {
+                const int x = (int)(nextRandom(&rng) % (uint32_t)map_cols);
+                const int y = (int)(nextRandom(&rng) % (uint32_t)map_rows);
+                map[y][x] = slopes[nextRandom(&rng) % 4];
+            }
+        }
+        is_ok &= reportSelfTest("ray_cache_slopes", is_equal);
+
+        destroyRayCache(&cache);
+        heapFree(directions);
+        heapFree(origins);
+        destroyMap(map, map_rows);
+    }
+
+    // the summed-area table kept up to date through the editor while cells and rectangles
+    // are painted, against counting the walls of random rectangles on the map
+    {
+        const int map_rows = 150;
+        const int map_cols = 170;
+
+        int** map = createMap(map_rows, map_cols);
+        SummedAreaTable sat = createSummedAreaTable(map, map_rows, map_cols, 16);
+        MapEditor editor = createMapEditor(map, map_rows, map_cols);
+        addMapEditListener(&editor, onMapEditSummedArea, &sat);
+
+        bool is_equal = true;
+        for (int frame = 0; frame < 200; frame++) {
+            const int x = (int)(nextRandom(&rng) % (uint32_t)map_cols);
+            const int y = (int)(nextRandom(&rng) % (uint32_t)map_rows);
+            const int value = (nextRandom(&rng) & 1) ? CELL_SOLID : CELL_OPEN;
+            if (frame % 10 == 0) {
+                editMapRect(&editor, x, y, x + 20, y + 12, value);
+            } else {
+                for (int i = 0; i < 3; i++) editMapCell(&editor, (x + i) % map_cols, y, value);
+            }
+            flushMapEdits(&editor);
+
+            const int x0 = (int)(nextRandom(&rng) % (uint32_t)map_cols);
+            const int y0 = (int)(nextRandom(&rng) % (uint32_t)map_rows);
+            const int x1 = x0 + (int)(nextRandom(&rng) % (uint32_t)(map_cols - x0));
+            const int y1 = y0 + (int)(nextRandom(&rng) % (uint32_t)(map_rows - y0));
+            int count = 0;
+            for (int j = y0; j <= y1; j++) {
+                for (int i = x0; i <= x1; i++) count += (map[j][i] != CELL_OPEN);
+            }
+            if (countWallsInRect(&sat, x0, y0, x1, y1) != count) is_equal = false;
+        }
+        is_ok &= reportSelfTest("summed_area_edits", is_equal);
+
+        destroySummedAreaTable(&sat);
+        destroyMap(map, map_rows);
+    }
+
+    // a streamed world through the slab pool makes no heap allocations after its first frame
+    {
+        const int chunk_size = 32;
+        const int window = 8;
+        const int frame_count = 2000;
+
+        ChunkPool pool;
+        initChunkPool(&pool, sizeof (int) * chunk_size * chunk_size, 64);
+        ChunkMagazine magazine = createChunkMagazine(&pool);
+        ChunkStream stream = createChunkStream(chunk_size, window, loadPillarChunk, NULL);
+
+        updateChunkStream(&stream, &magazine, 0, 0);
+        const long long heap_allocs = getHeapAllocCount();
+        for (int frame = 1; frame <= frame_count; frame++) {
+            const int center_y = (frame / 64) % 2 == 0 ? frame % 64 : 63 - frame % 64;
+            updateChunkStream(&stream, &magazine, frame, center_y);
+        }
+        is_ok &= reportSelfTest("chunk_stream_pool_heap_allocs", getHeapAllocCount() == heap_allocs);
+
+        destroyChunkStream(&stream, &magazine);
+        flushChunkMagazine(&magazine);
+        destroyChunkPool(&pool);
+    }
+
+    // the scratch data of a frame from an arena makes no heap allocations once the arena
+    // has grown to fit a frame
+    {
+        const int map_rows = 80;
+        const int map_cols = 80;
+        const float tile_size = 20.0f;
+        const float max_distance = 1000.0f;
+        const int agent_count = 1024;
+        const int frame_count = 16;
+        const int warmup_count = 2;
+        const float fan_angle_tolerance = 0.25f * DEG2RAD;
+        const int fan_max_rays = (int)ceilf(2.0f * PI / fan_angle_tolerance) + 32;
+
+        int** map = createMap(map_rows, map_cols);
+        for (int i = 0; i < map_rows; i++) {
+            for (int j = 0; j < map_cols; j++) {
+                map[i][j] = (nextRandomFloat(&rng) < 0.05f) ? CELL_SOLID : CELL_OPEN;
+            }
+        }
+
+        Arena arena = createArena(4096);
+        long long heap_allocs = 0;
+        for (int frame = 0; frame < warmup_count + frame_count; frame++) {
+            if (frame == warmup_count) heap_allocs = getHeapAllocCount();
+            resetArena(&arena);
+
+            Vector2* origins = allocArena(&arena, sizeof (Vector2) * agent_count);
+            Vector2* directions = allocArena(&arena, sizeof (Vector2) * agent_count);
+            float* distances = allocArena(&arena, sizeof (float) * agent_count);
+            for (int i = 0; i < agent_count; i++) {
+                const float angle = 2.0f * PI * nextRandomFloat(&rng);
+                origins[i] = (Vector2){
+                    nextRandomFloat(&rng) * (float)map_cols * tile_size,
+                    nextRandomFloat(&rng) * (float)map_rows * tile_size,
+                };
+                directions[i] = (Vector2){ cosf(angle), sinf(angle) };
+            }
+            RayBatchScratch scratch = allocRayBatchScratch(&arena, agent_count);
+            castRayBatchSorted(
+                origins,
+                directions,
+                agent_count,
+                map,
+                map_rows,
+                map_cols,
+                tile_size,
+                max_distance,
+                &scratch,
+                distances
+            );
+
+            FanRay* fan_rays = allocArena(&arena, sizeof (FanRay) * fan_max_rays);
+            int fan_rays_cast;
+            castAdaptiveFan(
+                origins[0],
+                map,
+                map_rows,
+                map_cols,
+                tile_size,
+                max_distance,
+                32,
+                fan_angle_tolerance,
+                tile_size,
+                fan_rays,
+                fan_max_rays,
+                &fan_rays_cast
+            );
+        }
+        is_ok &= reportSelfTest("frame_arena_heap_allocs", getHeapAllocCount() == heap_allocs);
+
+        destroyArena(&arena);
+        destroyMap(map, map_rows);
+    }
+
+    // four threads allocating and freeing through magazines of one pool at the same time,
+    // no block may be handed out twice and all of them have to come back
+    {
+        const int thread_count = 4;
+
+        ChunkPool pool;
+        initChunkPool(&pool, 64, 64);
+        MagazineStress stress[4];
+        pthread_t threads[4];
+        bool started[4] = { false };
+        for (int i = 0; i < thread_count; i++) {
+            stress[i] = (MagazineStress){ .pool = &pool, .thread_index = i, .round_count = 200000, .is_ok = true };
+            started[i] = pthread_create(&threads[i], NULL, runMagazineStress, &stress[i]) == 0;
+            if (!started[i]) runMagazineStress(&stress[i]);
         }
+
+        bool is_stress_ok = true;
+        for (int i = 0; i < thread_count; i++) {
+            if (started[i]) pthread_join(threads[i], NULL);
+            is_stress_ok &= stress[i].is_ok;
+        }
+        is_stress_ok &= pool.free_count == pool.slab_count * pool.blocks_per_slab;
+        is_ok &= reportSelfTest("chunk_magazine_stress", is_stress_ok);
+
+        destroyChunkPool(&pool);
     }
+
+    return is_ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }